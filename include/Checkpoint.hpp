@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Distance.hpp"
+
+// Binary checkpoint format (V2).
+//
+// Layout, little-endian, every section a multiple of 8 bytes:
+//   CheckpointHeader
+//   jumpCount x 32-byte big-endian jump distances
+//   dpCount x CheckpointRecord
+//   gpuPointBytes of GPU herd points, gpuDistBytes of GPU herd distances
+// The checksum covers the whole file with the checksum field zeroed.
+// Tame distances are relative to startRange, wild ones to the target.
+
+static const char kCheckpointMagic[8] = {'S', 'K', 'G', 'R',
+                                         'O', 'O', 'C', 'P'};
+static const uint32_t kCheckpointVersion = 2;
+
+// Header flag: symmetric interval with the negation map. Distances are
+// signed (two's complement in 176 bits), tame ones relative to the centre
+// of the range and wild ones to the target minus that centre.
+static const uint8_t kCheckpointSymmetric = 1;
+// Header flags: three or four herds (Galbraith-Pollard-Ruprai). Distances
+// are signed and centred as above; wilds of the second herd (tag bit 15)
+// are relative to minus the centred target.
+static const uint8_t kCheckpointThreeHerds = 2;
+static const uint8_t kCheckpointFourHerds = 4;
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint8_t startRange[32];  // Big-endian
+  uint8_t endRange[32];    // Big-endian
+  uint8_t target[33];      // Compressed public key
+  uint8_t flags;           // kCheckpoint* flags
+  uint8_t reserved[6];
+  int32_t dpBits;
+  uint32_t jumpCount;
+  uint64_t totalJumps;
+  double duration;
+  uint64_t dpCount;
+  uint64_t gpuPointBytes;
+  uint64_t gpuDistBytes;
+  uint64_t checksum;
+};
+static_assert(sizeof(CheckpointHeader) == 176, "Checkpoint header layout");
+
+// Same packing as a DPTable entry
+struct CheckpointRecord {
+  uint64_t fp;
+  uint64_t dist[2];
+  uint64_t distHiTag;  // Distance bits 128..175 | tag << 48
+};
+static_assert(sizeof(CheckpointRecord) == 32, "Checkpoint record layout");
+
+namespace Checkpoint {
+
+inline CheckpointRecord pack(uint64_t fp, const DPDistance& dist,
+                             uint16_t tag) {
+  CheckpointRecord r;
+  r.fp = fp;
+  r.dist[0] = dist.v[0];
+  r.dist[1] = dist.v[1];
+  r.distHiTag = (dist.v[2] & 0xFFFFFFFFFFFFULL) | ((uint64_t)tag << 48);
+  return r;
+}
+
+inline DPDistance distance(const CheckpointRecord& r) {
+  DPDistance d = DPDistance::zero();
+  d.v[0] = r.dist[0];
+  d.v[1] = r.dist[1];
+  d.v[2] = r.distHiTag & 0xFFFFFFFFFFFFULL;
+  return d;
+}
+
+inline uint16_t tag(const CheckpointRecord& r) {
+  return (uint16_t)(r.distHiTag >> 48);
+}
+
+// FNV-1a over 64-bit words (trailing bytes one at a time)
+uint64_t checksum(uint64_t h, const void* data, size_t len);
+static const uint64_t kChecksumSeed = 0xCBF29CE484222325ULL;
+
+// True if the file starts with the V2 magic
+bool isBinary(const std::string& file);
+
+}  // namespace Checkpoint
+
+// Streams a checkpoint to 'file.tmp' and renames it over 'file' once it is
+// complete and synced. Sections must be written in file order.
+class CheckpointWriter {
+ public:
+  // 'header' is copied; counts and checksum are filled in by finish()
+  CheckpointWriter(const std::string& file, const CheckpointHeader& header);
+  ~CheckpointWriter();
+
+  void writeJumps(const unsigned char* dists, uint32_t count);
+  void writeRecord(const CheckpointRecord& record);
+  // The batch herd: all of its points, then all of its distances, in as
+  // many calls as needed
+  void writeGpuPoints(const unsigned char* points, size_t bytes);
+  void writeGpuDists(const unsigned char* dists, size_t bytes);
+  void finish();
+
+ private:
+  void write(const void* data, size_t len);
+
+  std::string file;
+  std::string tmpFile;
+  FILE* fp = nullptr;
+  CheckpointHeader header;
+  uint64_t hash = Checkpoint::kChecksumSeed;
+};
+
+// Read-only memory mapping of a V2 checkpoint. The constructor validates
+// the header, section sizes and checksum, and throws on mismatch.
+class CheckpointReader {
+ public:
+  explicit CheckpointReader(const std::string& file);
+  ~CheckpointReader();
+
+  CheckpointReader(const CheckpointReader&) = delete;
+  CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+  const CheckpointHeader& header() const {
+    return *hdr;
+  }
+  const unsigned char* jumps() const {
+    return base + sizeof(CheckpointHeader);
+  }
+  const CheckpointRecord* records() const {
+    return reinterpret_cast<const CheckpointRecord*>(
+        jumps() + 32 * (size_t)hdr->jumpCount);
+  }
+  const unsigned char* gpuPoints() const {
+    return reinterpret_cast<const unsigned char*>(records() + hdr->dpCount);
+  }
+  const unsigned char* gpuDists() const {
+    return gpuPoints() + hdr->gpuPointBytes;
+  }
+
+ private:
+  const unsigned char* base = nullptr;
+  size_t size = 0;
+  const CheckpointHeader* hdr = nullptr;
+};
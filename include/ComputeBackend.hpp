@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HerdStore.hpp"
+
+struct Jump;
+
+// A device that walks a batch of kangaroos. The herd lives in a host
+// HerdStore between launches (affine points, distances as 4-limb scalars
+// mod N), so the solver loop, its checkpoints and its DP handling are the
+// same for every backend. Each step adds to every point the jump its X
+// selects (jumpIndex in HerdStepper.hpp), and the points that are DPs are
+// reported. With 'negationMap' points are kept as the even-y member of
+// {P, -P}, negating their distance, and 2-cycles are left with the escape
+// jump.
+class ComputeBackend {
+ public:
+  struct FoundDP {
+    uint32_t id;  // Kangaroo index
+    std::vector<unsigned char> x;
+    std::vector<unsigned char> y;
+    std::vector<unsigned char> dist;
+  };
+
+  virtual ~ComputeBackend() = default;
+
+  virtual const char* name() const = 0;
+
+  // 'escape' follows the table, at index jumpTable.size()
+  virtual void init(const std::vector<Jump>& jumpTable,
+                    const Jump& escape) = 0;
+
+  // Steps kangaroos [begin, begin + count) of 'herd' in place; found DP
+  // ids index into the herd
+  virtual void runStep(HerdStore& herd, uint32_t begin, uint32_t count,
+                       int numSteps, int dpBits, bool negationMap,
+                       std::vector<FoundDP>& foundDPs) = 0;
+
+  // runStep without waiting for it: those kangaroos and 'foundDPs' belong
+  // to the launch until the future is ready. One launch runs at a time.
+  // By default the launch blocks a thread of its own.
+  virtual std::future<void> submitStep(HerdStore& herd, uint32_t begin,
+                                       uint32_t count, int numSteps,
+                                       int dpBits, bool negationMap,
+                                       std::vector<FoundDP>& foundDPs);
+
+  // DPs one launch can return (the rest are lost), 0 for no limit
+  virtual uint32_t maxFoundDPs() const {
+    return 0;
+  }
+
+  // "cpu", or "metal" in builds with Metal. Throws for other names.
+  // 'threads' is a hint for host backends.
+  static std::unique_ptr<ComputeBackend> create(const std::string& name,
+                                                int threads);
+  static std::vector<std::string> available();
+};
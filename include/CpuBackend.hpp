@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ComputeBackend.hpp"
+#include "FieldElement.hpp"
+#include "HerdStepper.hpp"
+
+// The batch contract on host threads: each thread steps a slice of the
+// batch with a HerdStepper, so one field inversion serves the whole slice.
+// Walks are the same as the Metal kernel's.
+class CpuBackend : public ComputeBackend {
+ public:
+  // 'threads' <= 0: one per core
+  explicit CpuBackend(int threads);
+
+  const char* name() const override {
+    return "cpu";
+  }
+
+  void init(const std::vector<Jump>& jumpTable, const Jump& escape) override;
+
+  void runStep(HerdStore& herd, uint32_t begin, uint32_t count,
+               int numSteps, int dpBits, bool negationMap,
+               std::vector<FoundDP>& foundDPs) override;
+
+  // Little-endian 64-bit limbs of a scalar mod N: a batch distance
+  struct Scalar {
+    uint64_t v[4];
+  };
+
+ private:
+  int threads;
+  std::vector<AffinePoint> jumpPoints;
+  std::vector<Scalar> jumpDists;
+  AffinePoint escapePoint;
+  Scalar escapeDist;
+  std::vector<std::unique_ptr<HerdStepper>> steppers;  // One per thread
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Checkpoint.hpp"
+#include "DPSink.hpp"
+
+// Worker side of the DP protocol (see DPProtocol.hpp): buffers submitted
+// DPs and streams them to the collector from a sender thread, in batches,
+// reconnecting with exponential backoff. If the server falls behind or is
+// unreachable the buffer absorbs up to 'maxPending' DPs; beyond that new
+// DPs are dropped and counted.
+class DPClient : public DPSink {
+ public:
+  DPClient(const std::string& host, int port, size_t maxPending = 1 << 22);
+  ~DPClient();
+
+  DPClient(const DPClient&) = delete;
+  DPClient& operator=(const DPClient&) = delete;
+
+  // Connects (retrying until 'cancel') and receives the run configuration.
+  // Later reconnects are checked against it.
+  bool fetchConfig(CheckpointHeader& header, std::vector<unsigned char>& jumps,
+                   const std::atomic<bool>& cancel);
+
+  // Starts streaming; onStop runs when the server ends the run
+  void start(std::function<void()> onStop);
+  // Sends what is buffered (for a few seconds at most) and disconnects
+  void stop();
+
+  void submit(const DPRecord* dps, size_t count) override;
+  void reportJumps(uint64_t totalJumps) override;
+
+  uint64_t dropped() const {
+    return droppedCount;
+  }
+  // True (with the key) if the server stopped the run because it was found
+  bool serverFoundKey(std::string& keyHex) const;
+
+ private:
+  bool connectAndHello(CheckpointHeader& header,
+                       std::vector<unsigned char>& jumps);
+  void senderLoop();
+  void disconnect();
+
+  std::string host;
+  int port;
+  size_t maxPending;
+  int fd = -1;
+  CheckpointHeader config;
+
+  std::deque<CheckpointRecord> pending;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;  // Guarded by mutex
+  std::atomic<bool> serverStopped{false};
+  std::atomic<uint64_t> reportedJumps{0};
+  std::atomic<uint64_t> droppedCount{0};
+  std::string foundKeyHex;  // Written by the sender thread before joining
+
+  std::function<void()> onStop;
+  std::thread sender;
+};
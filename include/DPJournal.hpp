@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Checkpoint.hpp"
+
+// Append-only write-ahead journal of distinguished points.
+//
+// Every DP stored since the last checkpoint is appended to 'path' by a
+// background writer thread in checksummed batches (write + fdatasync).
+// A checkpoint calls rotate() before it snapshots the DP table and commit()
+// once it is on disk; the journal then only holds DPs newer than the
+// checkpoint. replay() recovers both journals after a crash, stopping at
+// the first torn batch.
+//
+// File layout: JournalHeader, then batches of JournalBatch + records.
+struct JournalHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint8_t startRange[32];
+  uint8_t endRange[32];
+  uint8_t target[33];
+  uint8_t flags;  // As in CheckpointHeader
+  uint8_t reserved[6];
+};
+static_assert(sizeof(JournalHeader) == 120, "Journal header layout");
+
+struct JournalBatch {
+  uint32_t count;
+  uint32_t reserved;
+  uint64_t checksum;  // Of the records that follow
+};
+
+class DPJournal {
+ public:
+  // Opens (or creates) the journal for the range/target in 'identity'.
+  // A valid journal is appended to; a torn tail is truncated away.
+  DPJournal(const std::string& path, const CheckpointHeader& identity,
+            size_t maxQueued = 1 << 20);
+  ~DPJournal();
+
+  DPJournal(const DPJournal&) = delete;
+  DPJournal& operator=(const DPJournal&) = delete;
+
+  // Never blocks on I/O. Returns false (and drops the record from the
+  // journal only) if the queue is full.
+  bool append(const CheckpointRecord& record);
+
+  // Checkpoint begins: everything appended so far moves to 'path.old'
+  void rotate();
+  // Checkpoint is on disk: 'path.old' is no longer needed
+  void commit();
+
+  uint64_t dropped() const {
+    return droppedCount;
+  }
+
+  // Upper bound on the records replay() will find, from the file sizes
+  static size_t pendingRecords(const std::string& path);
+
+  // Feeds the records of 'path.old' and 'path' to fn; returns their count
+  static size_t replay(
+      const std::string& path, const CheckpointHeader& identity,
+      const std::function<void(const CheckpointRecord&)>& fn);
+
+  // Same for the one journal file 'file'
+  static size_t replayFile(
+      const std::string& file, const CheckpointHeader& identity,
+      const std::function<void(const CheckpointRecord&)>& fn);
+
+ private:
+  void writerLoop();
+  void openFile();
+  void writeBatch(const std::vector<CheckpointRecord>& records);
+
+  // Length of the valid prefix of a journal file (0 if foreign/corrupt)
+  static size_t scan(const std::string& file, const JournalHeader& expected,
+                     const std::function<void(const CheckpointRecord&)>& fn);
+
+  std::string path;
+  JournalHeader header;
+  size_t maxQueued;
+  int fd = -1;
+
+  std::vector<CheckpointRecord> queue;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::condition_variable rotated;
+  bool stopping = false;
+  uint64_t rotateRequests = 0;  // Guarded by mutex
+  uint64_t rotateDone = 0;
+  std::atomic<uint64_t> droppedCount{0};
+
+  std::thread writer;
+};
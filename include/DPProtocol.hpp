@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wire protocol between DP workers (--connect) and the collector (--server).
+//
+// TCP, little-endian. Every message is a FrameHeader followed by 'length'
+// payload bytes:
+//   worker -> server  Hello      once per connection
+//   server -> worker  Config     CheckpointHeader + jumpCount x 32-byte jumps
+//   worker -> server  DPBatch    BatchHeader + count x CheckpointRecord
+//   server -> worker  Ack        empty, after each batch is stored
+//   server -> worker  Stop       instead of Ack once the key is found
+// A worker keeps one batch in flight and resends it after a reconnect, so
+// the server may see duplicates (the DP table ignores them).
+namespace DPProtocol {
+
+static const uint32_t kVersion = 1;
+static const uint32_t kMaxPayload = 64u << 20;
+
+enum MessageType : uint32_t {
+  kHello = 1,
+  kConfig = 2,
+  kDPBatch = 3,
+  kAck = 4,
+  kStop = 5
+};
+
+struct FrameHeader {
+  uint32_t type;
+  uint32_t length;
+};
+
+struct Hello {
+  uint32_t version;
+  uint32_t reserved;
+  char name[56];  // Worker host name, NUL-padded
+};
+
+struct BatchHeader {
+  uint64_t jumps;  // Jumps done since the previous acknowledged batch
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct Stop {
+  uint32_t found;
+  uint32_t reserved;
+  uint8_t key[32];  // Big-endian private key if found
+};
+
+// Frame I/O on a connected socket; false on error or disconnect
+bool sendFrame(int fd, uint32_t type, const void* a, size_t aLen,
+               const void* b = nullptr, size_t bLen = 0);
+bool recvFrame(int fd, uint32_t& type, std::vector<unsigned char>& payload);
+
+// recvFrame on fd fails after 'seconds' without data; 0 waits forever
+void setRecvTimeout(int fd, int seconds);
+
+// Returns a socket, or -1
+int connectTo(const std::string& host, int port);
+int listenOn(int port);
+
+// "host:port" -> parts; false if malformed
+bool parseAddress(const std::string& address, std::string& host, int& port);
+
+}  // namespace DPProtocol
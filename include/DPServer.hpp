@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Checkpoint.hpp"
+#include "DPTable.hpp"
+
+// Collector side of the DP protocol (see DPProtocol.hpp). Hands every
+// worker the run configuration (range, target, dpBits, jump table), then
+// feeds the DPs it streams to 'ingest', one thread per worker.
+class DPServer {
+ public:
+  // 'ingest' and 'addJumps' are called concurrently from worker threads
+  DPServer(int port, const CheckpointHeader& config,
+           const std::vector<unsigned char>& jumps,
+           std::function<void(const DPRecord&)> ingest,
+           std::function<void(uint64_t)> addJumps);
+  ~DPServer();
+
+  DPServer(const DPServer&) = delete;
+  DPServer& operator=(const DPServer&) = delete;
+
+  // Throws if the port cannot be bound
+  void start();
+
+  // Ends the run: workers get Stop (with the key if found) on their next
+  // batch. Waits briefly for them, then closes every connection.
+  void stop(bool found, const unsigned char* key);
+
+  // One line per worker: DPs, jumps and jump rate since the last call
+  void printStats(std::ostream& out);
+
+ private:
+  struct Worker {
+    std::string name;
+    int fd;
+    std::atomic<bool> connected{true};
+    std::atomic<uint64_t> dps{0};
+    std::atomic<uint64_t> jumps{0};
+    uint64_t lastJumps = 0;  // printStats only
+    std::chrono::steady_clock::time_point lastTime;
+    std::thread thread;
+  };
+
+  void acceptLoop();
+  void serveWorker(Worker* worker);
+  // Joins and drops disconnected workers whose stats have been printed;
+  // workersMutex must be held
+  void reapWorkers();
+
+  int port;
+  int listenFd = -1;
+  std::vector<unsigned char> configPayload;
+  std::function<void(const DPRecord&)> ingest;
+  std::function<void(uint64_t)> addJumps;
+
+  std::atomic<bool> stopping{false};
+  unsigned char stopPayload[40];  // DPProtocol::Stop, set before 'stopping'
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex workersMutex;
+  std::thread acceptor;
+};
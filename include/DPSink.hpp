@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DPTable.hpp"
+
+// Destination for the DPs a Kangaroo finds when they are not stored in its
+// own table (e.g. a worker streaming to a collector). Called from the
+// ingest thread and, when a walker's ring is full, from walker threads:
+// implementations must be thread-safe and must not block on I/O.
+class DPSink {
+ public:
+  virtual ~DPSink() {}
+
+  virtual void submit(const DPRecord* dps, size_t count) = 0;
+
+  // Total jumps done so far, for throughput stats
+  virtual void reportJumps(uint64_t totalJumps) {
+    (void)totalJumps;
+  }
+};
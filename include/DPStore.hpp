@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DPTable.hpp"
+
+// The DP table, optionally under a memory budget.
+//
+// Without a budget it is one DPTable. With one, a table that fills is
+// frozen and a fresh one takes the inserts; a background thread writes the
+// frozen table to 'dir' as a run (its records sorted by fingerprint) and
+// keeps only the run's Bloom filter and every kFence-th fingerprint in
+// memory. Another thread merges runs of the same size class, four into
+// one, so there are O(log n) of them. Inserts look the fingerprint up in
+// the frozen table and the runs (the filter first, then one block read)
+// before storing it, so the store keeps one entry per fingerprint across
+// its tiers. Runs are a spill area, not state: checkpoints hold every DP
+// and the files are removed with the store.
+class DPStore {
+ public:
+  // Spilled DPs cost this many bits of Bloom filter each
+  static const int kBloomBits = 10;
+  // Records per block read of a run lookup
+  static const size_t kFence = 64;
+
+  // memoryLimit 0: one table of 'capacity' entries that drops DPs once
+  // full. Otherwise the two tables and the sorted copy of a flush stay
+  // within memoryLimit bytes; the runs' filters and fences (about 11 bits
+  // per spilled DP) come on top. Throws if the limit cannot hold a small
+  // table or 'dir' cannot be created.
+  DPStore(size_t capacity, size_t memoryLimit = 0,
+          const std::string& dir = "");
+  ~DPStore();
+
+  DPStore(const DPStore&) = delete;
+  DPStore& operator=(const DPStore&) = delete;
+
+  // As DPTable::insert, also matching spilled DPs. Full only without a
+  // budget, or after a run could not be written.
+  DPTable::InsertResult insert(uint64_t fp, const DPDistance& dist,
+                               uint16_t tag, DPTable::Match* other,
+                               uint64_t* probes = nullptr);
+
+  // Entries in all tiers
+  size_t size() const;
+  // Entries of the in-memory table
+  size_t capacity() const {
+    return tableEntries;
+  }
+  // Bytes of the in-memory tables
+  size_t memoryBytes() const;
+
+  bool spills() const {
+    return memoryLimit > 0;
+  }
+  size_t spilled() const {
+    return spilledCount.load(std::memory_order_relaxed);
+  }
+  size_t runCount() const;
+
+  // Visits every entry, the tables' then the runs'. Safe to call during
+  // inserts, flushes and merges; entries added meanwhile may or may not be
+  // visited.
+  void forEach(const std::function<void(uint64_t fp, const DPDistance& dist,
+                                        uint16_t tag)>& fn) const;
+
+ private:
+  struct Run;
+
+  size_t memoryLimit = 0;
+  size_t tableEntries = 0;
+  std::string dir;
+  uint64_t nextRun = 0;
+
+  // Guards the tiers: inserts and lookups share it, swaps take it alone
+  mutable std::shared_mutex mutex;
+  std::condition_variable_any cv;
+  std::shared_ptr<DPTable> active;
+  std::shared_ptr<DPTable> frozen;  // Being written as a run
+  std::vector<std::shared_ptr<Run>> runs;  // Oldest first
+  std::atomic<size_t> spilledCount{0};
+  bool writeFailed = false;
+  bool stopping = false;
+
+  std::thread flusher;
+  std::thread merger;
+  void flushLoop();
+  void mergeLoop();
+
+  // Replaces 'full' with a fresh table once the last one is written
+  void rotate(const DPTable* full);
+  std::string runPath();
+  // Index of the first of four runs of one size class, or -1
+  int mergeable() const;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "Distance.hpp"
+#include "FieldElement.hpp"
+
+// A distinguished point on its way into the table
+struct DPRecord {
+  static const uint32_t kNoWalker = ~0u;
+
+  uint64_t fp;
+  DPDistance dist;
+  uint16_t tag;
+  // The local kangaroo that found it, if any (see Kangaroo::walkerId)
+  uint32_t walker = kNoWalker;
+};
+
+// Preallocated open-addressing table of distinguished points.
+//
+// Points are keyed on a 64-bit fingerprint of their x-coordinate; an entry
+// packs the fingerprint, a 176-bit distance and a 16-bit tag into 32 bytes.
+// Inserts claim a slot with a CAS and never take a lock, so any number of
+// walker threads can insert concurrently. A fingerprint match is only a
+// candidate: the caller verifies it by recovering and checking the key.
+class DPTable {
+ public:
+  // Distances are truncated to this many bits
+  static const int kDistanceBits = 176;
+
+  // Tag bit 0: kangaroo type. Bit 15: the second tame or wild herd of a
+  // three- or four-kangaroo run. Wild DPs carry their target's index in the
+  // bits between.
+  static const uint16_t kTagTame = 1;
+  static const uint16_t kTagSecondHerd = 0x8000;
+  static const uint32_t kMaxTargets = 1 << 14;
+
+  static uint16_t wildTag(uint32_t target) {
+    return (uint16_t)(target << 1);
+  }
+  static uint32_t targetIndex(uint16_t tag) {
+    return (tag & ~kTagSecondHerd) >> 1;
+  }
+
+  enum class InsertResult {
+    Inserted,  // New point stored
+    Matched,   // Fingerprint already present ('other' is filled in)
+    Full       // Load limit reached, point dropped
+  };
+
+  struct Match {
+    DPDistance dist;
+    uint16_t tag;
+  };
+
+  // capacity is rounded up to a power of 2
+  explicit DPTable(size_t capacity);
+
+  static uint64_t fingerprint(const FieldElement& x);
+
+  // 'probes', if given, is increased by the number of slots looked at
+  InsertResult insert(uint64_t fp, const DPDistance& dist, uint16_t tag,
+                      Match* other, uint64_t* probes = nullptr);
+  // Looks a fingerprint up without inserting it
+  bool find(uint64_t fp, Match* other) const;
+
+  size_t size() const {
+    return count.load(std::memory_order_relaxed);
+  }
+  size_t capacity() const {
+    return mask + 1;
+  }
+  size_t memoryBytes() const {
+    return capacity() * sizeof(Entry);
+  }
+
+  // Visits every published entry. Safe to call during inserts; entries
+  // added meanwhile may or may not be visited.
+  void forEach(const std::function<void(uint64_t fp, const DPDistance& dist,
+                                        uint16_t tag)>& fn) const;
+
+ private:
+  struct alignas(32) Entry {
+    std::atomic<uint64_t> fp{0};  // 0 = empty, 1 = being written
+    uint64_t dist[2] = {0, 0};
+    uint64_t distHiTag = 0;  // Distance bits 128..175 | tag << 48
+  };
+
+  static const uint64_t kEmpty = 0;
+  static const uint64_t kBusy = 1;
+
+  std::unique_ptr<Entry[]> entries;
+  size_t mask;
+  size_t loadLimit;
+  std::atomic<size_t> count{0};
+};
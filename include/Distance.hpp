@@ -0,0 +1,142 @@
+#pragma once
+
+#include <gmpxx.h>
+
+#include <cstdint>
+#include <vector>
+
+// Fixed-width unsigned kangaroo distance (little-endian 64-bit limbs).
+//
+// Arithmetic wraps modulo 2^(64 * Limbs), so the same type also holds the
+// two's complement distances of the negation map. The CPU walker picks the
+// width from the range size (64, 128 or 192 bits) so that a distance never
+// overflows in practice; GMP is only involved at setup and when a
+// collision is resolved.
+template <int Limbs>
+struct Distance {
+  uint64_t v[Limbs];
+
+  static Distance zero() {
+    Distance d;
+    for (int i = 0; i < Limbs; i++)
+      d.v[i] = 0;
+    return d;
+  }
+
+  Distance& operator+=(const Distance& o) {
+    uint64_t carry = 0;
+    for (int i = 0; i < Limbs; i++) {
+      uint64_t s = v[i] + carry;
+      carry = s < carry;
+      s += o.v[i];
+      carry += s < o.v[i];
+      v[i] = s;
+    }
+    return *this;
+  }
+
+  Distance& operator-=(const Distance& o) {
+    uint64_t borrow = 0;
+    for (int i = 0; i < Limbs; i++) {
+      uint64_t d = v[i] - o.v[i];
+      uint64_t b = v[i] < o.v[i];
+      b += d < borrow;
+      v[i] = d - borrow;
+      borrow = b;
+    }
+    return *this;
+  }
+
+  // Two's complement
+  void negate() {
+    uint64_t carry = 1;
+    for (int i = 0; i < Limbs; i++) {
+      v[i] = ~v[i] + carry;
+      carry = carry && v[i] == 0;
+    }
+  }
+
+  bool operator==(const Distance& o) const {
+    for (int i = 0; i < Limbs; i++) {
+      if (v[i] != o.v[i])
+        return false;
+    }
+    return true;
+  }
+
+  // Widen or truncate from another width
+  template <int Other>
+  static Distance from(const Distance<Other>& o) {
+    Distance d = zero();
+    for (int i = 0; i < Limbs && i < Other; i++)
+      d.v[i] = o.v[i];
+    return d;
+  }
+
+  // Widen (sign-extending) or truncate a two's complement distance
+  template <int Other>
+  static Distance fromSigned(const Distance<Other>& o) {
+    Distance d = from(o);
+    uint64_t ext = (o.v[Other - 1] >> 63) ? ~0ULL : 0;
+    for (int i = Other; i < Limbs; i++)
+      d.v[i] = ext;
+    return d;
+  }
+
+  // Low 64 * Limbs bits of a non-negative integer
+  static Distance fromMpz(const mpz_class& x) {
+    Distance d = zero();
+    size_t words = (mpz_sizeinbase(x.get_mpz_t(), 2) + 63) / 64;
+    std::vector<uint64_t> tmp(words + 1, 0);
+    size_t count = 0;
+    mpz_export(tmp.data(), &count, -1, sizeof(uint64_t), 0, 0,
+               x.get_mpz_t());
+    for (int i = 0; i < Limbs && (size_t)i < count; i++)
+      d.v[i] = tmp[i];
+    return d;
+  }
+
+  // Two's complement of a signed integer
+  static Distance fromSignedMpz(const mpz_class& x) {
+    if (x >= 0)
+      return fromMpz(x);
+    Distance d = fromMpz(-x);
+    d.negate();
+    return d;
+  }
+
+  // Low 64 * Limbs bits of a 32-byte big-endian integer (GPU distances)
+  static Distance fromBytes(const unsigned char* bytes) {
+    Distance d = zero();
+    for (int i = 0; i < Limbs && i < 4; i++) {
+      uint64_t limb = 0;
+      for (int j = 0; j < 8; j++)
+        limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+      d.v[i] = limb;
+    }
+    return d;
+  }
+
+  mpz_class toMpz() const {
+    mpz_class x;
+    mpz_import(x.get_mpz_t(), Limbs, -1, sizeof(uint64_t), 0, 0, v);
+    return x;
+  }
+
+  // Value of the low 'bits' bits read as two's complement
+  mpz_class toSignedMpz(int bits = 64 * Limbs) const {
+    mpz_class x = toMpz();
+    mpz_class mod = mpz_class(1) << bits;
+    x %= mod;
+    if (mpz_tstbit(x.get_mpz_t(), bits - 1))
+      x -= mod;
+    return x;
+  }
+};
+
+typedef Distance<1> Distance64;
+typedef Distance<2> Distance128;
+typedef Distance<3> Distance192;
+
+// Width of the distances kept in the DP table
+typedef Distance192 DPDistance;
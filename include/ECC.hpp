@@ -5,6 +5,8 @@
 #include <string>
 #include <gmp.h>
 
+#include "FieldElement.hpp"
+
 class ECC {
 public:
     ECC();
@@ -25,6 +27,10 @@ public:
     // Create a point from a scalar (P = scalar * G)
     bool getPubKeyFromPriv(secp256k1_pubkey& pubkey, const unsigned char* privKey);
 
+    // Convert to/from the native affine representation used by the walkers
+    AffinePoint toAffine(const secp256k1_pubkey& pubkey);
+    bool fromAffine(secp256k1_pubkey& pubkey, const AffinePoint& point);
+
     secp256k1_context* getContext() { return ctx; }
 
 private:
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Native secp256k1 field arithmetic for the CPU walkers.
+//
+// Host-side counterpart of the uint256 / mod_mul / reduce512 helpers in
+// kernels.metal, but on 4x64-bit limbs using 128-bit products. Values are
+// kept fully reduced (< p) after every operation, so limbs can be compared
+// and inspected directly (DP checks, jump index, serialization).
+
+struct FieldElement {
+  uint64_t v[4];  // Little-endian limbs: v[0] is least significant
+
+  static FieldElement zero() {
+    return {{0, 0, 0, 0}};
+  }
+  static FieldElement one() {
+    return {{1, 0, 0, 0}};
+  }
+
+  // 32-byte big-endian encoding (as produced by secp256k1 serialization)
+  static FieldElement fromBytes(const unsigned char* bytes);
+  void toBytes(unsigned char* bytes) const;
+
+  bool isZero() const {
+    return (v[0] | v[1] | v[2] | v[3]) == 0;
+  }
+  bool isOdd() const {
+    return v[0] & 1;
+  }
+  bool operator==(const FieldElement& o) const {
+    return v[0] == o.v[0] && v[1] == o.v[1] && v[2] == o.v[2] &&
+           v[3] == o.v[3];
+  }
+  bool operator!=(const FieldElement& o) const {
+    return !(*this == o);
+  }
+  bool operator<(const FieldElement& o) const {
+    for (int i = 3; i >= 0; i--) {
+      if (v[i] != o.v[i])
+        return v[i] < o.v[i];
+    }
+    return false;
+  }
+};
+
+struct AffinePoint {
+  FieldElement x;
+  FieldElement y;
+};
+
+namespace Field {
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+// p = 2^256 - 2^32 - 977, so 2^256 = 0x1000003D1 (mod p)
+constexpr uint64_t kReduce = 0x1000003D1ULL;
+
+// r = r - p if r >= p (r + 2^32 + 977 overflows exactly when r >= p)
+inline void normalize(uint64_t r[4]) {
+  uint128_t t = (uint128_t)r[0] + kReduce;
+  uint64_t s0 = (uint64_t)t;
+  t = (t >> 64) + r[1];
+  uint64_t s1 = (uint64_t)t;
+  t = (t >> 64) + r[2];
+  uint64_t s2 = (uint64_t)t;
+  t = (t >> 64) + r[3];
+  uint64_t s3 = (uint64_t)t;
+  if (t >> 64) {
+    r[0] = s0;
+    r[1] = s1;
+    r[2] = s2;
+    r[3] = s3;
+  }
+}
+
+// c = t mod p, t being a 512-bit product (8 limbs)
+inline void reduce512(FieldElement& c, const uint64_t t[8]) {
+  // Fold the high half: low + high * (2^32 + 977)
+  uint128_t acc = 0;
+  uint64_t r[4];
+  for (int i = 0; i < 4; i++) {
+    acc += (uint128_t)t[4 + i] * kReduce + t[i];
+    r[i] = (uint64_t)acc;
+    acc >>= 64;
+  }
+
+  // The overflow is at most 34 bits: fold it once more
+  acc = (uint128_t)(uint64_t)acc * kReduce + r[0];
+  r[0] = (uint64_t)acc;
+  acc >>= 64;
+  for (int i = 1; i < 4; i++) {
+    acc += r[i];
+    r[i] = (uint64_t)acc;
+    acc >>= 64;
+  }
+  if (acc) {
+    // Wrapped past 2^256; the low limbs are now tiny so this cannot carry
+    acc = (uint128_t)r[0] + kReduce;
+    r[0] = (uint64_t)acc;
+    r[1] += (uint64_t)(acc >> 64);
+  }
+
+  normalize(r);
+  c.v[0] = r[0];
+  c.v[1] = r[1];
+  c.v[2] = r[2];
+  c.v[3] = r[3];
+}
+
+inline void add(FieldElement& c, const FieldElement& a, const FieldElement& b) {
+  uint128_t t = 0;
+  uint64_t r[4];
+  for (int i = 0; i < 4; i++) {
+    t += (uint128_t)a.v[i] + b.v[i];
+    r[i] = (uint64_t)t;
+    t >>= 64;
+  }
+  if (t) {
+    // a + b - 2^256 + (2^32 + 977) = a + b - p < p, no further carry
+    t = (uint128_t)r[0] + kReduce;
+    r[0] = (uint64_t)t;
+    t >>= 64;
+    for (int i = 1; i < 4 && t; i++) {
+      t += r[i];
+      r[i] = (uint64_t)t;
+      t >>= 64;
+    }
+  } else {
+    normalize(r);
+  }
+  c.v[0] = r[0];
+  c.v[1] = r[1];
+  c.v[2] = r[2];
+  c.v[3] = r[3];
+}
+
+inline void sub(FieldElement& c, const FieldElement& a, const FieldElement& b) {
+  uint64_t borrow = 0;
+  uint64_t r[4];
+  for (int i = 0; i < 4; i++) {
+    uint128_t d = (uint128_t)a.v[i] - b.v[i] - borrow;
+    r[i] = (uint64_t)d;
+    borrow = (uint64_t)(d >> 64) & 1;
+  }
+  if (borrow) {
+    // r + p = r - (2^32 + 977) mod 2^256
+    borrow = 0;
+    uint128_t d = (uint128_t)r[0] - kReduce;
+    r[0] = (uint64_t)d;
+    borrow = (uint64_t)(d >> 64) & 1;
+    for (int i = 1; i < 4 && borrow; i++) {
+      d = (uint128_t)r[i] - borrow;
+      r[i] = (uint64_t)d;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+  }
+  c.v[0] = r[0];
+  c.v[1] = r[1];
+  c.v[2] = r[2];
+  c.v[3] = r[3];
+}
+
+inline void neg(FieldElement& c, const FieldElement& a) {
+  sub(c, FieldElement::zero(), a);
+}
+
+inline void mul(FieldElement& c, const FieldElement& a, const FieldElement& b) {
+  uint64_t t[8];
+  uint128_t acc;
+  uint64_t carry;
+
+  // Schoolbook 4x4 product, one row per limb of a
+  carry = 0;
+  for (int j = 0; j < 4; j++) {
+    acc = (uint128_t)a.v[0] * b.v[j] + carry;
+    t[j] = (uint64_t)acc;
+    carry = (uint64_t)(acc >> 64);
+  }
+  t[4] = carry;
+
+  for (int i = 1; i < 4; i++) {
+    carry = 0;
+    for (int j = 0; j < 4; j++) {
+      acc = (uint128_t)a.v[i] * b.v[j] + t[i + j] + carry;
+      t[i + j] = (uint64_t)acc;
+      carry = (uint64_t)(acc >> 64);
+    }
+    t[i + 4] = carry;
+  }
+
+  reduce512(c, t);
+}
+
+inline void sqr(FieldElement& c, const FieldElement& a) {
+  uint64_t t[8];
+  uint128_t acc;
+  uint64_t carry;
+
+  // Off-diagonal products a[i]*a[j] (i < j), doubled afterwards
+  carry = 0;
+  for (int j = 1; j < 4; j++) {
+    acc = (uint128_t)a.v[0] * a.v[j] + carry;
+    t[j] = (uint64_t)acc;
+    carry = (uint64_t)(acc >> 64);
+  }
+  t[4] = carry;
+
+  acc = (uint128_t)a.v[1] * a.v[2] + t[3];
+  t[3] = (uint64_t)acc;
+  acc = (uint128_t)a.v[1] * a.v[3] + t[4] + (uint64_t)(acc >> 64);
+  t[4] = (uint64_t)acc;
+  t[5] = (uint64_t)(acc >> 64);
+
+  acc = (uint128_t)a.v[2] * a.v[3] + t[5];
+  t[5] = (uint64_t)acc;
+  t[6] = (uint64_t)(acc >> 64);
+
+  t[7] = t[6] >> 63;
+  for (int i = 6; i > 1; i--) {
+    t[i] = (t[i] << 1) | (t[i - 1] >> 63);
+  }
+  t[1] <<= 1;
+
+  // Diagonal squares a[i]^2
+  carry = 0;
+  t[0] = 0;
+  for (int i = 0; i < 4; i++) {
+    acc = (uint128_t)a.v[i] * a.v[i] + t[2 * i] + carry;
+    t[2 * i] = (uint64_t)acc;
+    acc = (uint128_t)t[2 * i + 1] + (uint64_t)(acc >> 64);
+    t[2 * i + 1] = (uint64_t)acc;
+    carry = (uint64_t)(acc >> 64);
+  }
+
+  reduce512(c, t);
+}
+
+// r = a^-1 via Fermat (a^(p-2)); a must be non-zero
+void inv(FieldElement& r, const FieldElement& a);
+
+// a[i] = a[i]^-1 for i < n with a single inversion (Montgomery's trick),
+// the host equivalent of mod_inv_batched. 'scratch' must hold n elements
+// and every a[i] must be non-zero.
+void batchInverse(FieldElement* a, size_t n, FieldElement* scratch);
+
+// P = P + Q with a precomputed inverse of (Q.x - P.x).
+// Requires P != +-Q; this is the hot path of the walkers.
+inline void addWithInverse(AffinePoint& p, const AffinePoint& q,
+                           const FieldElement& invDx) {
+  FieldElement lambda, t, x3;
+  sub(t, q.y, p.y);
+  mul(lambda, t, invDx);
+  sqr(x3, lambda);
+  sub(x3, x3, p.x);
+  sub(x3, x3, q.x);
+  sub(t, p.x, x3);
+  mul(t, lambda, t);
+  sub(p.y, t, p.y);
+  p.x = x3;
+}
+
+// P = P + Q for arbitrary affine points (handles doubling).
+// Returns false if the result is the point at infinity (P == -Q).
+bool addPoints(AffinePoint& p, const AffinePoint& q);
+
+// 33-byte SEC1 compressed encoding (02/03 || X)
+void toCompressed(const AffinePoint& p, unsigned char* out);
+
+}  // namespace Field
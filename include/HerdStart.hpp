@@ -0,0 +1,46 @@
+#pragma once
+
+#include <gmpxx.h>
+#include <secp256k1.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Distance.hpp"
+#include "ECC.hpp"
+#include "FieldElement.hpp"
+
+// Where kangaroos of one kind start: at anchor + (base + o)G for offsets
+// o in [0, spread), even ones only if 'even'. Without an anchor, starts
+// are multiples of G. 'base' may be negative; scalars are taken mod N.
+//
+// spawn() draws one start with a scalar multiplication. fill() starts a
+// whole herd with at most kLanes of them: that many walks begin at random
+// offsets and step together over kStrides random strides averaging
+// spread / count, with one field inversion per step (HerdStepper), each
+// step giving one start per walk. The walks run on all OpenMP threads, or
+// on the calling one inside a parallel region. Neither starts at the point
+// at infinity (a zero scalar, or the anchor's negation).
+struct HerdStart {
+  static const int kLanes = 1024;
+  static const int kStrides = 64;
+
+  const secp256k1_pubkey* anchor = nullptr;
+  mpz_class base;
+  mpz_class spread;
+  bool even = false;
+
+  // Redraws the point at infinity; throws if the range holds little else
+  AffinePoint spawn(ECC& ecc, gmp_randclass& rr, Distance<4>& offset) const;
+
+  // Offsets are spread evenly rather than independently, from 'seed'.
+  // False if a walk hit the point at infinity (a degenerate range): spawn
+  // each kangaroo instead.
+  bool fill(size_t count, uint64_t seed, AffinePoint* points,
+            Distance<4>* offsets) const;
+
+ private:
+  mpz_class scalarAt(const mpz_class& offset) const;
+  // False at the point at infinity
+  bool pointAt(ECC& ecc, const mpz_class& offset, AffinePoint& point) const;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FieldElement.hpp"
+
+// Advances a CPU herd by one jump per kangaroo with batched-affine additions.
+//
+// On x86 CPUs with AVX-512 IFMA (8 lanes) or AVX2 (4 lanes) the field
+// arithmetic runs lane-parallel on 5x52-bit limbs, mirroring the SIMD-group
+// layout of kangaroo_step in kernels.metal: every lane walks its own
+// kangaroo, gathers its own jump, and the herd shares one inversion.
+// Elsewhere (or for degenerate steps) the portable 4x64 path is used.
+
+// Walk function: which jump a kangaroo at X takes. Must match the Metal
+// kernel (bits 32.. of X) so that CPU and GPU walks are interchangeable.
+// The low bits are the DP condition and would send every walk leaving a
+// DP down the same jump.
+inline int jumpIndex(const FieldElement& x, int tableSize) {
+  return (int)((x.v[0] >> 32) & (uint64_t)(tableSize - 1));
+}
+
+// DP condition: the low dpBits of X are zero
+inline bool isDistinguished(const FieldElement& x, int dpBits) {
+  uint64_t mask = dpBits >= 64 ? ~0ULL : (1ULL << dpBits) - 1;
+  return (x.v[0] & mask) == 0;
+}
+
+class HerdStepper {
+ public:
+  // 'jumps' must outlive the stepper; tableSize must be a power of 2
+  HerdStepper(const AffinePoint* jumps, int tableSize);
+
+  // Herd sizes should be a multiple of this to use the SIMD kernel
+  int laneWidth() const {
+    return lanes;
+  }
+  const char* isaName() const;
+
+  // points[k] += jumps[jumpIdx[k]] for k < n. Returns false if some
+  // kangaroo hit the point at infinity (P == -Jump).
+  bool step(AffinePoint* points, int n, int* jumpIdx);
+
+ private:
+  struct Kernel;
+  static const Kernel* selectKernel();
+
+  bool stepScalar(AffinePoint* points, int n, int* jumpIdx);
+
+  const AffinePoint* jumps;
+  int tableSize;
+  int lanes = 1;
+  const Kernel* kernel = nullptr;
+
+  // Jump table as 5x52-bit limbs, limb-major (limb * tableSize + index)
+  std::vector<uint64_t> jumpX52;
+  std::vector<uint64_t> jumpY52;
+
+  std::vector<uint64_t> work;
+  std::vector<FieldElement> dx;
+  std::vector<FieldElement> scratch;
+};
+
+namespace HerdKernel {
+
+// Arguments of a lane-parallel kernel (see HerdStepperKernel.hpp)
+struct Args {
+  const uint64_t* jumpX;
+  const uint64_t* jumpY;
+  int tableSize;
+  AffinePoint* points;
+  int n;  // Multiple of the lane width
+  int* jumpIdx;
+  uint64_t* work;  // 10 * n limbs
+};
+
+#if defined(SILIKANGAROO_X86_SIMD)
+bool stepAvx2(const Args& args);
+bool stepAvx512Ifma(const Args& args);
+#endif
+
+}  // namespace HerdKernel
@@ -0,0 +1,352 @@
+#pragma once
+
+// Lane-parallel herd step, shared by the AVX2 and AVX-512 IFMA translation
+// units. Include it only from files built with the matching -m flags: all
+// helpers live in an anonymous namespace and avoid inline functions from
+// other headers, so no ISA-specific code can leak into the rest of the
+// program through the linker's choice of inline definitions.
+//
+// Field elements are 5 limbs of 52 bits (the IFMA multiplier width). Every
+// operation leaves limbs < 2^52 with the value below 2^256 + 2^49, which is
+// all the multiplier needs; results are made canonical (< p) only when
+// written back to the herd.
+//
+// A vector backend V provides W lanes of 64-bit integers:
+//   T zero(), set1(x), iota(step), load(ptr), store(ptr, a)
+//   T add, sub, andv, orv, srli<S>, slli<S>, mul32
+//   T gather(base, idx), void scatter(base, idx, a)
+//   void madd52(lo, hi, a, b): lo += (a*b) mod 2^52, hi += (a*b) >> 52
+
+#include <cstdint>
+
+#include "HerdStepper.hpp"
+
+namespace HerdKernel {
+namespace {
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+constexpr uint64_t kM52 = 0xFFFFFFFFFFFFFULL;
+constexpr uint64_t kM48 = 0xFFFFFFFFFFFFULL;
+
+// 2^260 mod p
+constexpr uint64_t kR260 = 0x1000003D10ULL;
+
+// p in 52-bit limbs
+constexpr uint64_t kP52[5] = {0xFFFFEFFFFFC2FULL, kM52, kM52, kM52, kM48};
+
+// 32p with every limb >= 2^52, so that a + 32p - b cannot underflow a limb
+constexpr uint64_t k32P52[5] = {0x1FFFDFFFFF85E0ULL, 0x1FFFFFFFFFFFFEULL,
+                                0x1FFFFFFFFFFFFEULL, 0x1FFFFFFFFFFFFEULL,
+                                0x1FFFFFFFFFFFFEULL};
+
+template <class V>
+struct Fe {
+  typename V::T n[5];
+};
+
+// Propagate carries, fold everything above 2^256 back in (2^256 = 2^32 +
+// 977 mod p) and propagate again. Input limbs must be < 2^63.
+template <class V>
+inline void normalizeWeak(Fe<V>& r) {
+  typedef typename V::T T;
+  const T m52 = V::set1(kM52);
+
+  for (int i = 0; i < 4; i++) {
+    r.n[i + 1] = V::add(r.n[i + 1], V::template srli<52>(r.n[i]));
+    r.n[i] = V::andv(r.n[i], m52);
+  }
+
+  T top = V::template srli<48>(r.n[4]);
+  r.n[4] = V::andv(r.n[4], V::set1(kM48));
+  r.n[0] = V::add(r.n[0], V::mul32(top, V::set1(977)));
+  r.n[0] = V::add(r.n[0], V::template slli<32>(top));
+
+  for (int i = 0; i < 4; i++) {
+    r.n[i + 1] = V::add(r.n[i + 1], V::template srli<52>(r.n[i]));
+    r.n[i] = V::andv(r.n[i], m52);
+  }
+}
+
+template <class V>
+inline void add(Fe<V>& r, const Fe<V>& a, const Fe<V>& b) {
+  for (int i = 0; i < 5; i++)
+    r.n[i] = V::add(a.n[i], b.n[i]);
+  normalizeWeak(r);
+}
+
+template <class V>
+inline void sub(Fe<V>& r, const Fe<V>& a, const Fe<V>& b) {
+  for (int i = 0; i < 5; i++)
+    r.n[i] = V::sub(V::add(a.n[i], V::set1(k32P52[i])), b.n[i]);
+  normalizeWeak(r);
+}
+
+// Reduce a 10-limb product (limbs < 2^57) to a weakly normalized element
+template <class V>
+inline void reduceWide(Fe<V>& r, typename V::T t[10]) {
+  typedef typename V::T T;
+  const T m52 = V::set1(kM52);
+  const T r260 = V::set1(kR260);
+
+  for (int i = 0; i < 9; i++) {
+    t[i + 1] = V::add(t[i + 1], V::template srli<52>(t[i]));
+    t[i] = V::andv(t[i], m52);
+  }
+
+  // Fold limbs 5..9 (weights 2^260 and up) with 2^260 = kR260 (mod p)
+  T extra = V::zero();
+  for (int i = 0; i < 5; i++)
+    r.n[i] = t[i];
+  for (int i = 0; i < 4; i++)
+    V::madd52(r.n[i], r.n[i + 1], t[i + 5], r260);
+  V::madd52(r.n[4], extra, t[9], r260);
+
+  // extra < 2^37 sits at 2^260 again
+  V::madd52(r.n[0], r.n[1], extra, r260);
+
+  normalizeWeak(r);
+}
+
+template <class V>
+inline void mul(Fe<V>& r, const Fe<V>& a, const Fe<V>& b) {
+  typename V::T t[10];
+  for (int i = 0; i < 10; i++)
+    t[i] = V::zero();
+
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++)
+      V::madd52(t[i + j], t[i + j + 1], a.n[i], b.n[j]);
+  }
+
+  reduceWide(r, t);
+}
+
+template <class V>
+inline void sqr(Fe<V>& r, const Fe<V>& a) {
+  typename V::T t[10];
+  for (int i = 0; i < 10; i++)
+    t[i] = V::zero();
+
+  // Cross products once, doubled, then the squares
+  for (int i = 0; i < 5; i++) {
+    for (int j = i + 1; j < 5; j++)
+      V::madd52(t[i + j], t[i + j + 1], a.n[i], a.n[j]);
+  }
+  for (int i = 0; i < 10; i++)
+    t[i] = V::add(t[i], t[i]);
+  for (int i = 0; i < 5; i++)
+    V::madd52(t[2 * i], t[2 * i + 1], a.n[i], a.n[i]);
+
+  reduceWide(r, t);
+}
+
+// Load one coordinate (4x64 limbs at base + lane offset) into 5x52 form
+template <class V>
+inline void loadCoord(Fe<V>& r, const uint64_t* base, typename V::T offsets,
+                      typename V::T* low = nullptr) {
+  typedef typename V::T T;
+  const T m52 = V::set1(kM52);
+
+  T v0 = V::gather(base, offsets);
+  T v1 = V::gather(base + 1, offsets);
+  T v2 = V::gather(base + 2, offsets);
+  T v3 = V::gather(base + 3, offsets);
+  if (low)
+    *low = v0;
+
+  r.n[0] = V::andv(v0, m52);
+  r.n[1] = V::andv(V::orv(V::template srli<52>(v0), V::template slli<12>(v1)),
+                   m52);
+  r.n[2] = V::andv(V::orv(V::template srli<40>(v1), V::template slli<24>(v2)),
+                   m52);
+  r.n[3] = V::andv(V::orv(V::template srli<28>(v2), V::template slli<36>(v3)),
+                   m52);
+  r.n[4] = V::template srli<16>(v3);
+}
+
+// Reduce to the canonical value (< p) and store as 4x64 limbs
+template <class V>
+inline void storeCoord(uint64_t* base, typename V::T offsets, const Fe<V>& a) {
+  typedef typename V::T T;
+  const T m52 = V::set1(kM52);
+
+  // a < 2^256 + 2^49 < 2p: subtract p once unless that borrows
+  T s[5];
+  T borrow = V::zero();
+  for (int i = 0; i < 5; i++) {
+    T d = V::sub(V::sub(a.n[i], V::set1(kP52[i])), borrow);
+    borrow = V::template srli<63>(d);
+    s[i] = V::andv(d, m52);
+  }
+  T keep = V::sub(borrow, V::set1(1));  // All ones if a >= p
+  T r[5];
+  for (int i = 0; i < 5; i++)
+    r[i] = V::orv(V::andv(s[i], keep), V::andv(a.n[i], V::sub(V::zero(),
+                                                              borrow)));
+
+  V::scatter(base, offsets, V::orv(r[0], V::template slli<52>(r[1])));
+  V::scatter(base + 1, offsets,
+             V::orv(V::template srli<12>(r[1]), V::template slli<40>(r[2])));
+  V::scatter(base + 2, offsets,
+             V::orv(V::template srli<24>(r[2]), V::template slli<28>(r[3])));
+  V::scatter(base + 3, offsets,
+             V::orv(V::template srli<36>(r[3]), V::template slli<16>(r[4])));
+}
+
+template <class V>
+inline void gatherJump(Fe<V>& r, const uint64_t* table, int tableSize,
+                       typename V::T idx) {
+  for (int i = 0; i < 5; i++)
+    r.n[i] = V::gather(table + (size_t)i * tableSize, idx);
+}
+
+template <class V>
+inline void loadFe(Fe<V>& r, const uint64_t* p) {
+  for (int i = 0; i < 5; i++)
+    r.n[i] = V::load(p + i * V::W);
+}
+
+template <class V>
+inline void storeFe(uint64_t* p, const Fe<V>& a) {
+  for (int i = 0; i < 5; i++)
+    V::store(p + i * V::W, a.n[i]);
+}
+
+// Lane element (5x52, weakly normalized) to canonical 4x64
+inline void laneToField(FieldElement& r, const uint64_t* limbs, int lane,
+                        int width) {
+  uint64_t l[5];
+  for (int i = 0; i < 5; i++)
+    l[i] = limbs[i * width + lane];
+
+  uint128_t acc = (uint128_t)(l[4] >> 48) * 0x1000003D1ULL;
+  l[4] &= kM48;
+  uint64_t v[4] = {l[0] | (l[1] << 52), (l[1] >> 12) | (l[2] << 40),
+                   (l[2] >> 24) | (l[3] << 28), (l[3] >> 36) | (l[4] << 16)};
+  for (int i = 0; i < 4; i++) {
+    acc += v[i];
+    v[i] = (uint64_t)acc;
+    acc >>= 64;
+  }
+
+  // Now v < 2^256 and v < 2p: subtract p if v + (2^32 + 977) overflows
+  acc = (uint128_t)v[0] + 0x1000003D1ULL;
+  uint64_t s[4];
+  s[0] = (uint64_t)acc;
+  for (int i = 1; i < 4; i++) {
+    acc = (acc >> 64) + v[i];
+    s[i] = (uint64_t)acc;
+  }
+  bool ge = (acc >> 64) != 0;
+  for (int i = 0; i < 4; i++)
+    r.v[i] = ge ? s[i] : v[i];
+}
+
+inline void fieldToLane(uint64_t* limbs, int lane, int width,
+                        const FieldElement& a) {
+  limbs[0 * width + lane] = a.v[0] & kM52;
+  limbs[1 * width + lane] = ((a.v[0] >> 52) | (a.v[1] << 12)) & kM52;
+  limbs[2 * width + lane] = ((a.v[1] >> 40) | (a.v[2] << 24)) & kM52;
+  limbs[3 * width + lane] = ((a.v[2] >> 28) | (a.v[3] << 36)) & kM52;
+  limbs[4 * width + lane] = a.v[3] >> 16;
+}
+
+// One jump for every kangaroo: forward pass builds per-lane prefix products
+// of the denominators, the W lane totals share one scalar inversion, and the
+// backward pass peels individual inverses off while applying the additions.
+template <class V>
+bool stepHerd(const Args& args) {
+  typedef typename V::T T;
+  const int W = V::W;
+  const int groups = args.n / W;
+  const size_t stride = 10 * W;  // dx + prefix per group
+
+  // AffinePoint is 8 limbs: x at +0, y at +4
+  const T offsets = V::iota(8);
+  const T idxMask = V::set1((uint64_t)(args.tableSize - 1));
+
+  uint64_t lane[5 * W];
+  uint64_t idxOut[W];
+
+  Fe<V> acc;
+  for (int g = 0; g < groups; g++) {
+    const uint64_t* base = (const uint64_t*)(args.points + g * W);
+    Fe<V> x, jx, d;
+    T low;
+    loadCoord<V>(x, base, offsets, &low);
+
+    T idx = V::andv(V::template srli<32>(low), idxMask);
+    V::store(idxOut, idx);
+    for (int j = 0; j < W; j++)
+      args.jumpIdx[g * W + j] = (int)idxOut[j];
+
+    gatherJump<V>(jx, args.jumpX, args.tableSize, idx);
+    sub(d, jx, x);
+    if (g == 0)
+      acc = d;
+    else
+      mul(acc, acc, d);
+
+    storeFe(args.work + g * stride, d);
+    storeFe(args.work + g * stride + 5 * W, acc);
+  }
+
+  // Invert the lane totals. A zero total means some P.x == Jump.x: leave
+  // the herd untouched and let the caller take the scalar path.
+  FieldElement totals[W];
+  FieldElement scratch[W];
+  storeFe(lane, acc);
+  for (int j = 0; j < W; j++) {
+    laneToField(totals[j], lane, j, W);
+    if ((totals[j].v[0] | totals[j].v[1] | totals[j].v[2] | totals[j].v[3]) ==
+        0)
+      return false;
+  }
+  Field::batchInverse(totals, W, scratch);
+  for (int j = 0; j < W; j++)
+    fieldToLane(lane, j, W, totals[j]);
+  Fe<V> inv;
+  loadFe(inv, lane);
+
+  for (int g = groups - 1; g >= 0; g--) {
+    uint64_t* base = (uint64_t*)(args.points + g * W);
+    Fe<V> d, invDx;
+    loadFe(d, args.work + g * stride);
+    if (g > 0) {
+      Fe<V> prefix;
+      loadFe(prefix, args.work + (g - 1) * stride + 5 * W);
+      mul(invDx, inv, prefix);
+      mul(inv, inv, d);
+    } else {
+      invDx = inv;
+    }
+
+    Fe<V> x, y, jx, jy;
+    T low;
+    loadCoord<V>(x, base, offsets, &low);
+    loadCoord<V>(y, base + 4, offsets);
+    T idx = V::andv(V::template srli<32>(low), idxMask);
+    gatherJump<V>(jx, args.jumpX, args.tableSize, idx);
+    gatherJump<V>(jy, args.jumpY, args.tableSize, idx);
+
+    // lambda = (Jy - y) / (Jx - x); x3 = lambda^2 - x - Jx;
+    // y3 = lambda * (x - x3) - y
+    Fe<V> t, lambda, x3, y3;
+    sub(t, jy, y);
+    mul(lambda, t, invDx);
+    sqr(x3, lambda);
+    sub(x3, x3, x);
+    sub(x3, x3, jx);
+    sub(t, x, x3);
+    mul(t, lambda, t);
+    sub(y3, t, y);
+
+    storeCoord<V>(base, offsets, x3);
+    storeCoord<V>(base + 4, offsets, y3);
+  }
+  return true;
+}
+
+}  // namespace
+}  // namespace HerdKernel
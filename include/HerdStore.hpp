@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "FieldElement.hpp"
+
+// The positions and distances of a herd, as two arrays in one arena: the
+// affine points (one cache line each), then the distances as fixed-width
+// little-endian limbs. Arenas of 2 MiB and more are aligned for
+// transparent huge pages, and ask for them. The arrays never move, so
+// walkers, backends and checkpoints all work on them in place.
+class HerdStore {
+ public:
+  // Bytes per distance in the big-endian exchange format of checkpoints
+  static const size_t kDistanceBytes = 32;
+
+  HerdStore() = default;
+  // Zeroed; throws std::bad_alloc if the arena cannot be mapped
+  HerdStore(size_t count, int distanceLimbs);
+  ~HerdStore();
+
+  HerdStore(HerdStore&& o) noexcept;
+  HerdStore& operator=(HerdStore&& o) noexcept;
+  HerdStore(const HerdStore&) = delete;
+  HerdStore& operator=(const HerdStore&) = delete;
+
+  size_t size() const {
+    return count;
+  }
+  bool empty() const {
+    return count == 0;
+  }
+  int distanceLimbs() const {
+    return limbs;
+  }
+  size_t arenaBytes() const {
+    return bytes;
+  }
+  bool hugePages() const {
+    return huge;
+  }
+
+  AffinePoint* points() {
+    return pts;
+  }
+  const AffinePoint* points() const {
+    return pts;
+  }
+
+  // Limbs of kangaroo i's distance
+  uint64_t* distance(size_t i) {
+    return dist + i * limbs;
+  }
+
+  // The distance array as T, a struct of distanceLimbs() uint64_t limbs
+  // (Distance<Limbs>, CpuBackend::Scalar)
+  template <class T>
+  T* distances() {
+    static_assert(sizeof(T) % sizeof(uint64_t) == 0, "Limb array");
+    return reinterpret_cast<T*>(dist);
+  }
+  template <class T>
+  const T* distances() const {
+    return reinterpret_cast<const T*>(dist);
+  }
+
+  // Copies kangaroos [begin, begin + n) of a store as wide as this one
+  void copyFrom(const HerdStore& from, size_t begin, size_t n);
+
+  // Kangaroos [begin, begin + n) as 64-byte big-endian X|Y and 32-byte
+  // big-endian distances
+  void exportPoints(size_t begin, size_t n, unsigned char* out) const;
+  void exportDistances(size_t begin, size_t n, unsigned char* out) const;
+  void importPoints(size_t begin, size_t n, const unsigned char* in);
+  // Distances wider than the store are truncated
+  void importDistances(size_t begin, size_t n, const unsigned char* in);
+
+ private:
+  size_t count = 0;
+  int limbs = 0;
+  void* arena = nullptr;
+  size_t bytes = 0;
+  bool huge = false;
+  AffinePoint* pts = nullptr;
+  uint64_t* dist = nullptr;
+
+  void release();
+};
@@ -4,52 +4,82 @@
 #include <secp256k1.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "Checkpoint.hpp"
+#include "ComputeBackend.hpp"
+#include "DPJournal.hpp"
+#include "DPStore.hpp"
+#include "DPSink.hpp"
+#include "DPTable.hpp"
+#include "Distance.hpp"
 #include "ECC.hpp"
-#include "MetalAccelerator.hpp"
+#include "FieldElement.hpp"
+#include "HerdStore.hpp"
+#include "Metrics.hpp"
+#include "SpscRing.hpp"
+#include "TameDatabase.hpp"
 
 struct Jump {
   mpz_class dist;
   secp256k1_pubkey point;
-};
-
-struct DistinguishedPoint {
-  mpz_class distance;
-  bool isTame;  // true = tame, false = wild
-                // potentially store starting info if multiple kangaroos
+  AffinePoint affine;  // Same point, for the native CPU walker
 };
 
 class Kangaroo {
  public:
+  // All targets lie in [startRange, endRange] and share one tame herd
   Kangaroo(const mpz_class& startRange, const mpz_class& endRange,
-           const std::string& targetPubKeyHex, int numThreads = -1);
+           const std::vector<std::string>& targetPubKeyHexes,
+           int numThreads = -1);
   ~Kangaroo();
 
   void run();
 
   mpz_class getPrivateKey() const {
-    return privateKey;
+    return privateKeys[0];
   }
+  // True once every target is solved
   bool isFound() const {
     return found;
   }
 
+  size_t getTargetCount() const {
+    return targets.size();
+  }
+  bool isSolved(size_t target) const {
+    return solved[target];
+  }
+  // Valid for solved targets once run() has returned
+  const std::vector<mpz_class>& getPrivateKeys() const {
+    return privateKeys;
+  }
+
   // Statistics
   uint64_t getTotalJumps() const {
-    return totalJumps;
+    return loadedJumps + metrics.total(Metrics::Jumps);
   }
   double getDuration() const;
   double getOpsPerSecond() const;
   double getEstimatedSecondsRemaining() const;
-
-  void setUseGPU(bool use) {
-    useGPU = use;
+  // Model of the jumps to a solution for the jump table and herd in use
+  double getExpectedJumps() const;
+  // Counters of this process (jumps exclude those of a resumed checkpoint)
+  const Metrics& getMetrics() const {
+    return metrics;
   }
 
+  // Walk a batch of kangaroos on a ComputeBackend ("metal", "cpu")
+  // instead of the CPU herds; throws if this build lacks it
+  void setBackend(const std::string& name);
+
   void setDpBits(int bits) {
     dpBits = bits;
     manualDpBits = true;
@@ -61,10 +91,65 @@ class Kangaroo {
     manualGpuParams = true;
   }
 
+  void setCpuHerdSize(int size) {
+    cpuHerdSize = size;
+  }
+
+  // Seeds the jump table and every herd (by default from the clock). Each
+  // component and thread draws from its own stream derived from it.
+  void setSeed(uint64_t value) {
+    seed = value;
+  }
+  uint64_t getSeed() const {
+    return seed;
+  }
+
+  // Worker mode: DPs go to 'sink' (not owned) instead of the local table
+  void setDPSink(DPSink* sink) {
+    dpSink = sink;
+  }
+
+  // Collector mode: run() serves DPs from --connect workers on 'port'
+  void setServerPort(int port) {
+    serverPort = port;
+  }
+
+  // Symmetric interval with the negation map (Galbraith-Ruprai): walks
+  // on {P, -P} classes around the centre of the range
+  void setNegationMap(bool enable);
+
+  // Herd layout of a search: 2 (tame and wild), 3 (one tame, wilds from
+  // the key and from its negation) or 4 (two tames of opposite parity and
+  // those two wilds) after Galbraith-Pollard-Ruprai. More herds cut the
+  // expected work from 2*sqrt(N) to 1.82 and 1.71*sqrt(N).
+  void setHerds(int count);
+  int getHerds() const {
+    return herds;
+  }
+
+  // Bernstein-Lange precomputation: a tame-only run that stops after
+  // 'tameDPs' DPs and writes them to a tame database for this width...
+  void setPrecompute(const std::string& file, size_t tameDPs);
+  // ...and a wild-only run that solves against such a database
+  void setTameDatabase(const std::string& file);
+
+  // Number of random jumps (power of 2, 32..4096); their mean is set
+  // from the number of kangaroos when run() starts
+  void setJumpTableSize(int size);
+
+  // Replace the random jump table (e.g. with the collector's)
+  void setJumpDistances(const std::vector<mpz_class>& dists);
+
   void setCheckpointFile(const std::string& file) {
     checkpointFile = file;
   }
 
+  // Keep the DP table within 'bytes' of RAM, spilling to sorted runs in
+  // '<checkpoint file>.runs' (0: no limit, the default)
+  void setDpMemoryLimit(size_t bytes) {
+    dpMemoryLimit = bytes;
+  }
+
   void saveCheckpoint(const std::string& file);
   void loadCheckpoint(const std::string& file);
   void requestCheckpoint(const std::string& file);
@@ -81,39 +166,157 @@ class Kangaroo {
   mpz_class startRange;
   mpz_class endRange;
   mpz_class rangeSize;
-  std::string targetHex;
-  secp256k1_pubkey targetPubKey;
+  // Wild DPs carry the index of their target (DPTable::wildTag)
+  std::vector<secp256k1_pubkey> targets;
+  std::vector<std::vector<unsigned char>> targetKeys;  // Compressed
+  mpz_class groupOrder;
+
+  enum class Mode { Search, Precompute, Solve };
+  Mode mode = Mode::Search;
+  std::string tameDbFile;
+  size_t tameDbTarget = 0;  // Precompute: DPs to collect
+  std::unique_ptr<TameDatabase> tameDb;  // Solve
+  // Wild kangaroos start from here: the targets, shifted into the tame
+  // database's interval in solve mode or by -center in centred searches
+  std::vector<secp256k1_pubkey> walkTargets;
+  // Three and four herds: the second wild herd starts from -walkTargets
+  std::vector<secp256k1_pubkey> negatedWalkTargets;
+
+  bool negationMap = false;
+  int herds = 2;
+  mpz_class center;  // (startRange + endRange) / 2
+  // Distances are signed and relative to the centre of the range
+  bool centered() const {
+    return negationMap || herds > 2;
+  }
+  void centerTargets();
+
+  enum class Herd { Tame, Wild, SecondTame, SecondWild };
+  // Herd of a search slot: slots cycle through the herds
+  Herd herdOf(int slot) const;
+  static bool isTameHerd(Herd herd) {
+    return herd == Herd::Tame || herd == Herd::SecondTame;
+  }
+  static uint16_t herdTag(Herd herd, uint32_t target);
+  std::atomic<uint64_t> cycleEscapes{0};
+  std::atomic<uint64_t> cycleRestarts{0};
+  // A negation-map walk this long without a DP is caught in a longer
+  // fruitless cycle (4-cycles come about once in n^3/4 jumps)
+  uint64_t maxWalkLength() const {
+    return 16ULL << dpBits;
+  }
+  void writeTameDatabase();
 
   int numThreads;
-  bool useGPU = false;
+  std::string backendName;  // Empty: CPU herds
+
+  uint64_t seed;
+  enum class RngStream { JumpTable, GpuHerd, CpuHerd };
+  // GMP seed for one stream; 'index' tells threads apart
+  mpz_class streamSeed(RngStream stream, uint64_t index = 0) const;
   ECC ecc;  // Main ECC context
 
-  MetalAccelerator metalAccel;
+  std::unique_ptr<ComputeBackend> backend;  // Created by run()
 
   std::vector<Jump> jumpTable;
-  void initJumpTable();
+  // Negation map: leaves fruitless cycles. The sum of all jumps, which no
+  // one or two table jumps can undo.
+  Jump escapeJump;
+  int jumpTableSize = 0;  // Default: 32, 2048 with the negation map
+  bool jumpsFixed = false;  // Loaded from a checkpoint, server or database
+  // Read by the monitor thread for the estimate
+  std::atomic<double> walkKangaroos{0};  // Kangaroos walking in parallel
+  std::atomic<double> jumpMean{0};
+  // Random table unless fixed, with mean m*sqrt(N)/4 for m = 'kangaroos'
+  // walking in parallel (van Oorschot-Wiener)
+  void initJumpTable(double kangaroos);
+  void randomJumpTable(double kangaroos);
+  void buildJumpTable(const std::vector<mpz_class>& dists);
+
+  // Shared state. Tame distances are relative to startRange (the key at a
+  // tame DP is startRange + distance), wild distances to the target. With
+  // the negation map both are signed and centred (see Checkpoint.hpp).
+  std::unique_ptr<DPStore> dpTable;
+  std::atomic<bool> dpTableFull{false};
+  size_t dpMemoryLimit = 0;
+  std::mutex resultMutex;  // Guards privateKeys
+  void initDPTable(size_t minEntries = 0);
+
+  // Write-ahead journal of the DPs stored since the last checkpoint
+  std::unique_ptr<DPJournal> journal;
+  void openJournal();
+
+  // DP pipeline: each walker pushes into its own ring, the ingest thread
+  // drains the rings into dpTable and hands tame/wild matches to the
+  // verification thread.
+  std::vector<std::unique_ptr<SpscRing<DPRecord>>> dpQueues;
+  std::thread ingestThread;
+  std::thread verifyThread;
+  std::atomic<bool> pipelineStop{false};
+  // (known, wild): 'known' is tame or the wild DP of a solved target
+  std::deque<std::pair<DPRecord, DPRecord>> candidates;
+  std::mutex candidateMutex;
+  std::condition_variable candidateCv;
+  bool verifyStop = false;  // Guarded by candidateMutex
 
-  // Shared state
-  std::unordered_map<std::string, DistinguishedPoint>
-      distinguishedPoints;  // Key: compressed point (33 bytes)
-  std::mutex mapMutex;
+  DPSink* dpSink = nullptr;
+  int serverPort = 0;
+  void runServer();
+
+  void startDPPipeline(int producers);
+  void stopDPPipeline();
+  void ingestLoop();
+  void verifyLoop();
+  // Never blocks: falls back to a direct table insert if the ring is full
+  void pushDP(int producer, const FieldElement& x, const DPDistance& dist,
+              uint16_t tag, uint32_t walker = DPRecord::kNoWalker);
+
+  // Search walkers that hit a DP of their own kind (tame/tame or wilds of
+  // one target) follow another kangaroo's trail from there on: they are
+  // queued here and their thread respawns them. Walker ids are
+  // producer * walkersPerProducer + slot.
+  uint32_t walkersPerProducer = 1;
+  uint32_t walkerId(int producer, int slot) const {
+    return (uint32_t)producer * walkersPerProducer + (uint32_t)slot;
+  }
+  std::mutex deadMutex;
+  std::vector<std::vector<int>> deadSlots;  // Per producer
+  std::atomic<uint64_t> deadQueued{0};
+  void markDead(uint32_t walker);
+  // Moves the slots queued for 'producer' into 'slots' (sorted, unique)
+  void takeDead(int producer, std::vector<int>& slots);
+  void storeDPs(const DPRecord* dps, size_t count);
 
   std::atomic<bool> found{false};
   std::atomic<bool> shouldStop{false};
-  mpz_class privateKey;
+  std::vector<mpz_class> privateKeys;
+  std::unique_ptr<std::atomic<bool>[]> solved;
+  std::atomic<size_t> solvedCount{0};
+  // Walkers move the wilds of solved targets to this one
+  uint32_t nextUnsolvedTarget(uint32_t target) const;
 
-  std::atomic<uint64_t> totalJumps{0};
+  Metrics metrics;
   std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
 
   // DP condition: e.g. last N bits are zero
   int dpBits;
   bool isDistinguished(const secp256k1_pubkey& point);
+  bool isDistinguished(const AffinePoint& point) const;
 
-  // Helper to process collision
-  void processCollision(const std::string& pointHex, const mpz_class& dist,
-                        bool isTame);
+  // Stores a DP and queues a match that can give a key: tame/wild, or two
+  // wilds of which one target is solved
+  void processCollision(const DPRecord& dp);
+  void queueCandidate(const DPRecord& known, const DPRecord& wild);
+  void verifyCollision(const DPRecord& known, const DPRecord& wild);
+
+  // CPU herd walker, instantiated for 64-, 128- and 192-bit distances
+  template <int Limbs>
+  void runCpuHerds();
+  // Cycle escapes and restarts, respawned kangaroos
+  void printWalkStats();
 
   // Optimization & Checkpoint params
+  int cpuHerdSize = 512;  // Kangaroos per CPU thread
   int gpuBatchSize = 1024;
   int stepsPerLaunch = 64;
   std::string checkpointFile;
@@ -122,9 +325,31 @@ class Kangaroo {
   std::atomic<bool> checkpointRequested{false};
   std::mutex checkpointMutex;
 
+  void fillCheckpointHeader(CheckpointHeader& header);
+  // Checkpoints taken while the solver runs are written by a thread of
+  // their own. The solver only pauses to hand over a herd at rest (the
+  // batch loop copies its halves into checkpointHerd as they land); the
+  // DP table is read while walkers go on inserting, and the journal,
+  // rotated first, holds the DPs the file may miss.
+  std::thread checkpointWriter;
+  std::atomic<bool> checkpointWriting{false};
+  HerdStore checkpointHerd;
+  // 'herd' must stay untouched until the write is done
+  void beginCheckpoint(const std::string& file, const HerdStore& herd);
+  void finishCheckpoint();  // Waits for a background write, if any
+  void writeCheckpoint(const std::string& file, const CheckpointHeader& header,
+                       const HerdStore& herd);
+  // extraDPs: room to reserve in the DP table for the journal replay
+  void loadCheckpointV1(const std::string& file, size_t extraDPs);
+  void loadCheckpointV2(const std::string& file, size_t extraDPs);
+
   // Saved state for resume
   bool loadedFromCheckpoint = false;
+  uint64_t loadedJumps = 0;
   double loadedDuration = 0.0;
-  std::vector<unsigned char> savedGpuPoints;
-  std::vector<unsigned char> savedGpuDists;
+  // The batch herd: loaded by a resume, walked by the batch loop and
+  // written by checkpoints in place
+  HerdStore batchHerd;
+  void loadBatchHerd(const unsigned char* points, size_t pointBytes,
+                     const unsigned char* dists, size_t distBytes);
 };
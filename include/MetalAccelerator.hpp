@@ -5,37 +5,40 @@
 #include <string>
 #include <vector>
 
+#include "ComputeBackend.hpp"
+
 #ifdef __OBJC__
 #import <Metal/Metal.h>
 #else
 typedef void* id;
 #endif
 
-// Forward declarations
-struct Jump;
-
-class MetalAccelerator {
+class MetalAccelerator : public ComputeBackend {
  public:
   MetalAccelerator();
-  ~MetalAccelerator();
+  ~MetalAccelerator() override;
+
+  const char* name() const override {
+    return "metal";
+  }
 
-  void init(const std::vector<Jump>& jumpTable);
+  // 'escape' is uploaded after the table, at index jumpTable.size()
+  void init(const std::vector<Jump>& jumpTable, const Jump& escape) override;
 
-  struct FoundDP {
-    uint32_t id;
-    std::vector<unsigned char> x;
-    std::vector<unsigned char> y;
-    std::vector<unsigned char> dist;
-  };
+  uint32_t maxFoundDPs() const override {
+    return 4096;
+  }
 
   // Run a batch of kangaroos
   // Returns true if any kangaroo found the key (though exact key retrieval
   // might need CPU check) 'points': input/output kangaroo positions (64 bytes
   // per point: 32 bytes X + 32 bytes Y) 'distances': input/output distances (32
-  // bytes per distance)
-  void runStep(std::vector<unsigned char>& points,
-               std::vector<unsigned char>& distances, int numSteps, int dpBits,
-               std::vector<FoundDP>& foundDPs);
+  // bytes per distance).
+  // With 'negationMap' each step keeps the even-y point of {P, -P},
+  // negating its distance mod N, and leaves 2-cycles with the next jump.
+  void runStep(HerdStore& herd, uint32_t begin, uint32_t count,
+               int numSteps, int dpBits, bool negationMap,
+               std::vector<FoundDP>& foundDPs) override;
 
   // Debug: Run a math test on GPU
   // op: 0=add, 1=mul, 2=inv
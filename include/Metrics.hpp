@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Hot-path counters. A thread that calls bindThread() gets a cache line of
+// its own and bumps it with plain relaxed stores; other threads share one
+// slot with atomic adds. Readers sum the slots without locking, so a
+// snapshot may be a few increments behind.
+class Metrics {
+ public:
+  enum Counter {
+    Jumps,
+    DPs,                // Found by walkers (or received by the DP server)
+    TableInserts,       // New DPs stored
+    TableProbes,        // Slots looked at by those inserts and the matches
+    TameCollisions,     // Tame met tame: a duplicate trail
+    WildCollisions,     // Wild met wild
+    Candidates,         // Matches queued for verification
+    FalseCandidates,    // Verified matches that gave no key
+    DeadKangaroos,      // Walkers respawned after merging into a trail
+    QueueFull,          // DPs a walker stored itself: its ring was full
+    QueueWaitNs,        // Time walkers spent doing so
+    LockWaitNs,         // Time spent waiting for the candidate queue
+    Checkpoints,
+    CheckpointNs,       // Time spent writing them
+    BackendWaitNs,      // Time the batch loop waited for its backend
+    CheckpointStallNs,  // Time the solver paused to snapshot checkpoints
+    kCounters
+  };
+
+  enum Gauge {
+    DPTableEntries,  // In all tiers of the DP store
+    DPTableCapacity,
+    ExpectedJumps,
+    DPSpilledEntries,  // In runs on disk
+    DPRuns,
+    kGauges
+  };
+
+  static const char* name(Counter c);
+  static const char* name(Gauge g);
+
+  struct Snapshot {
+    uint64_t counters[kCounters];
+    double gauges[kGauges];
+  };
+
+  Metrics() : id(++instances) {}
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  // Gives the calling thread a slot of its own, if any is left
+  void bindThread();
+
+  void add(Counter c, uint64_t n = 1) {
+    if (boundTo == id) {
+      std::atomic<uint64_t>& v = boundSlot->v[c];
+      v.store(v.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+    } else {
+      slots[0].v[c].fetch_add(n, std::memory_order_relaxed);
+    }
+  }
+
+  void setGauge(Gauge g, double value) {
+    gauges[g].store(value, std::memory_order_relaxed);
+  }
+
+  uint64_t total(Counter c) const;
+  Snapshot snapshot() const;
+
+  // Elapsed nanoseconds, for the *Ns counters
+  static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  static const int kSlots = 256;
+
+  struct alignas(128) Slot {
+    std::atomic<uint64_t> v[kCounters] = {};
+  };
+
+  Slot slots[kSlots];  // 0 is shared
+  std::atomic<int> usedSlots{1};
+  std::atomic<double> gauges[kGauges] = {};
+
+  // Threads outlive instances (OpenMP pools), and a new instance may get
+  // an old one's address: bindings name instances by a unique id
+  static std::atomic<uint64_t> instances;
+  const uint64_t id;
+  static thread_local uint64_t boundTo;
+  static thread_local Slot* boundSlot;
+};
+
+// Writes a Metrics snapshot every few seconds: JSON lines appended to a
+// file, or Prometheus text that replaces the file (for a textfile
+// collector). "-" writes to stdout.
+class MetricsExporter {
+ public:
+  enum class Format { Json, Prometheus };
+
+  // Throws if 'path' cannot be opened
+  MetricsExporter(const Metrics& metrics, const std::string& path,
+                  Format format, double intervalSeconds);
+  ~MetricsExporter();
+
+  void start();
+  // Writes a final sample
+  void stop();
+
+  static bool parseFormat(const std::string& s, Format& format);
+
+ private:
+  const Metrics& metrics;
+  std::string path;
+  Format format;
+  double interval;
+  FILE* out = nullptr;
+
+  std::chrono::steady_clock::time_point startTime;
+  uint64_t lastJumps = 0;
+  double lastSeconds = 0;
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;  // Guarded by mutex
+
+  void loop();
+  void write();
+};
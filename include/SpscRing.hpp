@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free single-producer / single-consumer ring buffer.
+// One thread calls tryPush, one (other) thread calls popBatch.
+template <typename T>
+class SpscRing {
+ public:
+  // capacity is rounded up to a power of 2
+  explicit SpscRing(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity)
+      n <<= 1;
+    buffer.resize(n);
+    mask = n - 1;
+  }
+
+  // Returns false if the ring is full
+  bool tryPush(const T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - headCache > mask) {
+      headCache = head.load(std::memory_order_acquire);
+      if (t - headCache > mask)
+        return false;
+    }
+    buffer[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves up to maxItems into out, returns the number moved
+  size_t popBatch(T* out, size_t maxItems) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t n = t - h;
+    if (n > maxItems)
+      n = maxItems;
+    for (size_t i = 0; i < n; i++)
+      out[i] = buffer[(h + i) & mask];
+    head.store(h + n, std::memory_order_release);
+    return n;
+  }
+
+ private:
+  std::vector<T> buffer;
+  size_t mask;
+
+  // Producer and consumer indices on separate cache lines
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  size_t headCache = 0;  // Producer's last view of head
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Checkpoint.hpp"
+
+// Precomputed tame DPs for one interval width and jump table
+// (Bernstein-Lange). Stored as a V2 checkpoint with an all-zero target and
+// its records sorted by fingerprint, so that lookups binary-search the
+// memory mapping. Tame distances are relative to the header's startRange.
+class TameDatabase {
+ public:
+  // Throws if 'file' is not a valid tame database
+  explicit TameDatabase(const std::string& file);
+
+  const CheckpointHeader& header() const {
+    return reader.header();
+  }
+  const unsigned char* jumps() const {
+    return reader.jumps();
+  }
+  size_t size() const {
+    return reader.header().dpCount;
+  }
+
+  bool find(uint64_t fp, DPDistance& dist) const;
+
+  // Sorts 'records' and writes them with 'header' (target is cleared)
+  static void write(const std::string& file, const CheckpointHeader& header,
+                    const std::vector<unsigned char>& jumps,
+                    std::vector<CheckpointRecord>& records);
+
+ private:
+  CheckpointReader reader;
+};
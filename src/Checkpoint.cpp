@@ -0,0 +1,167 @@
+#include "Checkpoint.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace Checkpoint {
+
+uint64_t checksum(uint64_t h, const void* data, size_t len) {
+  const uint64_t prime = 0x100000001B3ULL;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  size_t words = len / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t w;
+    std::memcpy(&w, p + 8 * i, 8);
+    h = (h ^ w) * prime;
+  }
+  for (size_t i = 8 * words; i < len; i++)
+    h = (h ^ p[i]) * prime;
+  return h;
+}
+
+bool isBinary(const std::string& file) {
+  FILE* f = fopen(file.c_str(), "rb");
+  if (!f)
+    return false;
+  char magic[8];
+  bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+            std::memcmp(magic, kCheckpointMagic, sizeof(magic)) == 0;
+  fclose(f);
+  return ok;
+}
+
+}  // namespace Checkpoint
+
+CheckpointWriter::CheckpointWriter(const std::string& file,
+                                   const CheckpointHeader& header)
+    : file(file), tmpFile(file + ".tmp"), header(header) {
+  fp = fopen(tmpFile.c_str(), "wb");
+  if (!fp)
+    throw std::runtime_error("Failed to open checkpoint file: " + tmpFile);
+  setvbuf(fp, nullptr, _IOFBF, 1 << 20);
+
+  std::memcpy(this->header.magic, kCheckpointMagic, sizeof(header.magic));
+  this->header.version = kCheckpointVersion;
+  this->header.headerSize = sizeof(CheckpointHeader);
+  this->header.jumpCount = 0;
+  this->header.dpCount = 0;
+  this->header.gpuPointBytes = 0;
+  this->header.gpuDistBytes = 0;
+  this->header.checksum = 0;
+
+  // Placeholder, rewritten by finish()
+  if (fwrite(&this->header, sizeof(CheckpointHeader), 1, fp) != 1)
+    throw std::runtime_error("Failed to write checkpoint file: " + tmpFile);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (fp) {
+    // Not finished: leave the previous checkpoint in place
+    fclose(fp);
+    unlink(tmpFile.c_str());
+  }
+}
+
+void CheckpointWriter::write(const void* data, size_t len) {
+  if (len == 0)
+    return;
+  if (fwrite(data, 1, len, fp) != len)
+    throw std::runtime_error("Failed to write checkpoint file: " + tmpFile);
+  hash = Checkpoint::checksum(hash, data, len);
+}
+
+void CheckpointWriter::writeJumps(const unsigned char* dists, uint32_t count) {
+  write(dists, 32 * (size_t)count);
+  header.jumpCount += count;
+}
+
+void CheckpointWriter::writeRecord(const CheckpointRecord& record) {
+  write(&record, sizeof(record));
+  header.dpCount++;
+}
+
+void CheckpointWriter::writeGpuPoints(const unsigned char* points,
+                                      size_t bytes) {
+  write(points, bytes);
+  header.gpuPointBytes += bytes;
+}
+
+void CheckpointWriter::writeGpuDists(const unsigned char* dists,
+                                     size_t bytes) {
+  write(dists, bytes);
+  header.gpuDistBytes += bytes;
+}
+
+void CheckpointWriter::finish() {
+  // The header is hashed last, with its checksum field still zero
+  header.checksum = 0;
+  header.checksum = Checkpoint::checksum(hash, &header, sizeof(header));
+
+  bool ok = fseek(fp, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, fp) == 1 && fflush(fp) == 0 &&
+            fsync(fileno(fp)) == 0;
+  ok = (fclose(fp) == 0) && ok;
+  fp = nullptr;
+  if (!ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+    unlink(tmpFile.c_str());
+    throw std::runtime_error("Failed to write checkpoint file: " + file);
+  }
+}
+
+CheckpointReader::CheckpointReader(const std::string& file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open checkpoint file: " + file);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+    close(fd);
+    throw std::runtime_error("Truncated checkpoint file: " + file);
+  }
+  size = (size_t)st.st_size;
+
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw std::runtime_error("Failed to map checkpoint file: " + file);
+  base = static_cast<const unsigned char*>(map);
+  hdr = reinterpret_cast<const CheckpointHeader*>(base);
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  std::string error;
+  if (std::memcmp(hdr->magic, kCheckpointMagic, sizeof(hdr->magic)) != 0) {
+    error = "Not a binary checkpoint: ";
+  } else if (hdr->version != kCheckpointVersion ||
+             hdr->headerSize != sizeof(CheckpointHeader)) {
+    error = "Unsupported checkpoint version: ";
+  } else if (sizeof(CheckpointHeader) + 32 * (size_t)hdr->jumpCount +
+                 sizeof(CheckpointRecord) * hdr->dpCount +
+                 hdr->gpuPointBytes + hdr->gpuDistBytes !=
+             size) {
+    error = "Truncated checkpoint file: ";
+  } else {
+    uint64_t h = Checkpoint::checksum(
+        Checkpoint::kChecksumSeed, base + sizeof(CheckpointHeader),
+        size - sizeof(CheckpointHeader));
+    CheckpointHeader copy = *hdr;
+    copy.checksum = 0;
+    if (Checkpoint::checksum(h, &copy, sizeof(copy)) != hdr->checksum)
+      error = "Checkpoint checksum mismatch: ";
+  }
+
+  if (!error.empty()) {
+    munmap(map, size);
+    base = nullptr;
+    throw std::runtime_error(error + file);
+  }
+}
+
+CheckpointReader::~CheckpointReader() {
+  if (base)
+    munmap(const_cast<unsigned char*>(base), size);
+}
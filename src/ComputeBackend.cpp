@@ -0,0 +1,40 @@
+#include "ComputeBackend.hpp"
+
+#include <stdexcept>
+
+#include "CpuBackend.hpp"
+#ifdef SILIKANGAROO_METAL
+#include "MetalAccelerator.hpp"
+#endif
+
+std::unique_ptr<ComputeBackend> ComputeBackend::create(const std::string& name,
+                                                       int threads) {
+  if (name == "cpu")
+    return std::unique_ptr<ComputeBackend>(new CpuBackend(threads));
+#ifdef SILIKANGAROO_METAL
+  if (name == "metal")
+    return std::unique_ptr<ComputeBackend>(new MetalAccelerator());
+#endif
+  std::string names;
+  for (const std::string& n : available())
+    names += (names.empty() ? "" : ", ") + n;
+  throw std::runtime_error("Unknown backend '" + name + "' (this build has " +
+                           names + ")");
+}
+
+std::future<void> ComputeBackend::submitStep(HerdStore& herd, uint32_t begin,
+                                             uint32_t count, int numSteps,
+                                             int dpBits, bool negationMap,
+                                             std::vector<FoundDP>& foundDPs) {
+  return std::async(std::launch::async, [=, &herd, &foundDPs] {
+    runStep(herd, begin, count, numSteps, dpBits, negationMap, foundDPs);
+  });
+}
+
+std::vector<std::string> ComputeBackend::available() {
+#ifdef SILIKANGAROO_METAL
+  return {"cpu", "metal"};
+#else
+  return {"cpu"};
+#endif
+}
@@ -0,0 +1,180 @@
+#include "CpuBackend.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <utility>
+
+#include "Kangaroo.hpp"
+#include "Utils.hpp"
+
+namespace {
+
+typedef CpuBackend::Scalar Scalar;
+
+const Scalar kOrder = {{0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL,
+                        0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL}};
+
+Scalar scalarFromBytes(const unsigned char* bytes) {
+  Scalar s;
+  for (int i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (int j = 0; j < 8; j++)
+      limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+    s.v[i] = limb;
+  }
+  return s;
+}
+
+void scalarToBytes(const Scalar& s, unsigned char* bytes) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 8; j++)
+      bytes[(3 - i) * 8 + j] = (unsigned char)(s.v[i] >> (56 - 8 * j));
+  }
+}
+
+// a - b over 256 bits, returning the borrow
+uint64_t subtract(Scalar& r, const Scalar& a, const Scalar& b) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    Field::uint128_t d = (Field::uint128_t)a.v[i] - b.v[i] - borrow;
+    r.v[i] = (uint64_t)d;
+    borrow = (uint64_t)(d >> 64) & 1;
+  }
+  return borrow;
+}
+
+// a += b mod N, for a, b < N (as scalar_add in the Metal kernel)
+void addMod(Scalar& a, const Scalar& b) {
+  Field::uint128_t carry = 0;
+  for (int i = 0; i < 4; i++) {
+    carry += (Field::uint128_t)a.v[i] + b.v[i];
+    a.v[i] = (uint64_t)carry;
+    carry >>= 64;
+  }
+  Scalar r;
+  if (subtract(r, a, kOrder) == 0 || carry)
+    a = r;
+}
+
+// a = N - a, keeping 0
+void negateMod(Scalar& a) {
+  if ((a.v[0] | a.v[1] | a.v[2] | a.v[3]) != 0)
+    subtract(a, kOrder, a);
+}
+
+}  // namespace
+
+CpuBackend::CpuBackend(int threads) : threads(threads) {
+  if (this->threads <= 0)
+    this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void CpuBackend::init(const std::vector<Jump>& jumpTable, const Jump& escape) {
+  jumpPoints.resize(jumpTable.size());
+  jumpDists.resize(jumpTable.size());
+  unsigned char bytes[32];
+  for (size_t i = 0; i < jumpTable.size(); i++) {
+    jumpPoints[i] = jumpTable[i].affine;
+    Utils::mpzToBytes(jumpTable[i].dist.get_mpz_t(), bytes);
+    jumpDists[i] = scalarFromBytes(bytes);
+  }
+  // The sum of all jumps may pass N
+  mpz_class order(
+      "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141", 16);
+  mpz_class escapeMod = escape.dist % order;
+  escapePoint = escape.affine;
+  Utils::mpzToBytes(escapeMod.get_mpz_t(), bytes);
+  escapeDist = scalarFromBytes(bytes);
+
+  steppers.clear();
+  for (int t = 0; t < threads; t++) {
+    steppers.emplace_back(
+        new HerdStepper(jumpPoints.data(), (int)jumpPoints.size()));
+  }
+}
+
+void CpuBackend::runStep(HerdStore& herd, uint32_t begin, uint32_t count,
+                         int numSteps, int dpBits, bool negationMap,
+                         std::vector<FoundDP>& foundDPs) {
+  if (count == 0 || steppers.empty())
+    return;
+
+  // Slices of whole SIMD lanes
+  int lanes = steppers[0]->laneWidth();
+  int slice = ((int)count + threads - 1) / threads;
+  slice = (slice + lanes - 1) / lanes * lanes;
+  int tableSize = (int)jumpPoints.size();
+
+#pragma omp parallel num_threads(threads)
+  {
+    int t = omp_get_thread_num();
+    int first = std::min((int)count, t * slice);
+    int n = std::min((int)count, first + slice) - first;
+
+    // Walked in place
+    AffinePoint* p = herd.points() + begin + first;
+    Scalar* d = herd.distances<Scalar>() + begin + first;
+    std::vector<int> jumpIdx(n);
+    std::vector<FieldElement> lastX, lastX2;
+    if (negationMap) {
+      lastX.assign(n, FieldElement::zero());
+      lastX2.assign(n, FieldElement::zero());
+    }
+    std::vector<FoundDP> found;
+
+    auto canonicalize = [&](int k) {
+      if (p[k].y.isOdd()) {
+        Field::neg(p[k].y, p[k].y);
+        negateMod(d[k]);
+      }
+    };
+
+    if (negationMap) {
+      for (int k = 0; k < n; k++)
+        canonicalize(k);
+    }
+
+    for (int s = 0; s < numSteps && n > 0; s++) {
+      // A kangaroo at infinity (P == -Jump) stays there: degenerate range
+      steppers[t]->step(p, n, jumpIdx.data());
+
+      for (int k = 0; k < n; k++) {
+        addMod(d[k], jumpDists[jumpIdx[k]]);
+
+        if (negationMap) {
+          canonicalize(k);
+          if (p[k].x == lastX2[k] && p[k].x < lastX[k]) {
+            // P -> -(P + J) -> P: escape jump and P's own, as on the GPU
+            int i = jumpIndex(p[k].x, tableSize);
+            Field::addPoints(p[k], escapePoint);
+            Field::addPoints(p[k], jumpPoints[i]);
+            addMod(d[k], escapeDist);
+            addMod(d[k], jumpDists[i]);
+            canonicalize(k);
+          }
+          lastX2[k] = lastX[k];
+          lastX[k] = p[k].x;
+        }
+
+        if (isDistinguished(p[k].x, dpBits)) {
+          FoundDP dp;
+          dp.id = begin + (uint32_t)(first + k);
+          dp.x.resize(32);
+          dp.y.resize(32);
+          dp.dist.resize(32);
+          p[k].x.toBytes(dp.x.data());
+          p[k].y.toBytes(dp.y.data());
+          scalarToBytes(d[k], dp.dist.data());
+          found.push_back(std::move(dp));
+        }
+      }
+    }
+
+#pragma omp critical
+    foundDPs.insert(foundDPs.end(), std::make_move_iterator(found.begin()),
+                    std::make_move_iterator(found.end()));
+  }
+}
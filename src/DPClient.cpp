@@ -0,0 +1,216 @@
+#include "DPClient.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "DPProtocol.hpp"
+#include "Utils.hpp"
+
+// Records per DPBatch message
+static const size_t kBatchRecords = 4096;
+
+DPClient::DPClient(const std::string& host, int port, size_t maxPending)
+    : host(host), port(port), maxPending(maxPending) {
+  std::memset(&config, 0, sizeof(config));
+}
+
+DPClient::~DPClient() {
+  stop();
+  disconnect();
+}
+
+void DPClient::disconnect() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+bool DPClient::connectAndHello(CheckpointHeader& header,
+                               std::vector<unsigned char>& jumps) {
+  fd = DPProtocol::connectTo(host, port);
+  if (fd < 0)
+    return false;
+
+  DPProtocol::Hello hello;
+  std::memset(&hello, 0, sizeof(hello));
+  hello.version = DPProtocol::kVersion;
+  gethostname(hello.name, sizeof(hello.name) - 1);
+
+  uint32_t type;
+  std::vector<unsigned char> payload;
+  if (!DPProtocol::sendFrame(fd, DPProtocol::kHello, &hello, sizeof(hello)) ||
+      !DPProtocol::recvFrame(fd, type, payload) ||
+      type != DPProtocol::kConfig || payload.size() < sizeof(header)) {
+    disconnect();
+    return false;
+  }
+
+  std::memcpy(&header, payload.data(), sizeof(header));
+  if (std::memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) != 0 ||
+      payload.size() != sizeof(header) + 32 * (size_t)header.jumpCount) {
+    disconnect();
+    return false;
+  }
+  jumps.assign(payload.begin() + sizeof(header), payload.end());
+  return true;
+}
+
+bool DPClient::fetchConfig(CheckpointHeader& header,
+                           std::vector<unsigned char>& jumps,
+                           const std::atomic<bool>& cancel) {
+  int backoff = 1;
+  while (!cancel) {
+    if (connectAndHello(header, jumps)) {
+      config = header;
+      return true;
+    }
+    std::cerr << "Cannot reach DP server " << host << ":" << port
+              << ", retrying in " << backoff << "s" << std::endl;
+    for (int i = 0; i < backoff * 10 && !cancel; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    backoff = std::min(backoff * 2, 30);
+  }
+  return false;
+}
+
+void DPClient::start(std::function<void()> onStop) {
+  this->onStop = onStop;
+  sender = std::thread(&DPClient::senderLoop, this);
+}
+
+void DPClient::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cv.notify_one();
+  if (sender.joinable())
+    sender.join();
+}
+
+void DPClient::submit(const DPRecord* dps, size_t count) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++) {
+      if (pending.size() >= maxPending) {
+        droppedCount += count - i;
+        break;
+      }
+      pending.push_back(Checkpoint::pack(dps[i].fp, dps[i].dist, dps[i].tag));
+    }
+    if (pending.size() < kBatchRecords)
+      return;
+  }
+  cv.notify_one();
+}
+
+void DPClient::reportJumps(uint64_t totalJumps) {
+  reportedJumps = totalJumps;
+}
+
+bool DPClient::serverFoundKey(std::string& keyHex) const {
+  if (!serverStopped || foundKeyHex.empty())
+    return false;
+  keyHex = foundKeyHex;
+  return true;
+}
+
+void DPClient::senderLoop() {
+  std::vector<CheckpointRecord> batch;
+  uint64_t sentJumps = 0;
+  int backoff = 1;
+  auto stopDeadline = std::chrono::steady_clock::time_point::max();
+
+  for (;;) {
+    bool stop;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      // Heartbeat at least every second so the server sees our jumps
+      if (batch.empty()) {
+        cv.wait_for(lock, std::chrono::seconds(1), [&] {
+          return stopping || pending.size() >= kBatchRecords;
+        });
+        size_t n = std::min(pending.size(), kBatchRecords);
+        batch.assign(pending.begin(), pending.begin() + n);
+        pending.erase(pending.begin(), pending.begin() + n);
+      }
+      stop = stopping;
+    }
+
+    if (stop) {
+      if (stopDeadline == std::chrono::steady_clock::time_point::max()) {
+        stopDeadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      }
+      if (std::chrono::steady_clock::now() > stopDeadline)
+        return;  // Give up on what is left
+    }
+
+    if (fd < 0) {
+      CheckpointHeader header;
+      std::vector<unsigned char> jumps;
+      if (!connectAndHello(header, jumps)) {
+        if (stop)
+          return;
+        std::this_thread::sleep_for(std::chrono::seconds(backoff));
+        backoff = std::min(backoff * 2, 30);
+        continue;
+      }
+      if (std::memcmp(header.target, config.target, sizeof(header.target)) ||
+          std::memcmp(header.startRange, config.startRange, 32) ||
+          std::memcmp(header.endRange, config.endRange, 32)) {
+        std::cerr << "DP server switched to another target, stopping"
+                  << std::endl;
+        disconnect();
+        serverStopped = true;
+        if (onStop)
+          onStop();
+        return;
+      }
+      backoff = 1;
+    }
+
+    uint64_t jumps = reportedJumps;
+    DPProtocol::BatchHeader bh = {jumps - sentJumps, (uint32_t)batch.size(),
+                                  0};
+    uint32_t type;
+    std::vector<unsigned char> reply;
+    if (!DPProtocol::sendFrame(fd, DPProtocol::kDPBatch, &bh, sizeof(bh),
+                               batch.data(),
+                               batch.size() * sizeof(CheckpointRecord)) ||
+        !DPProtocol::recvFrame(fd, type, reply)) {
+      std::cerr << "Lost connection to DP server, reconnecting" << std::endl;
+      disconnect();
+      continue;  // Resend the same batch
+    }
+
+    if (type == DPProtocol::kStop) {
+      DPProtocol::Stop s;
+      if (reply.size() == sizeof(s)) {
+        std::memcpy(&s, reply.data(), sizeof(s));
+        if (s.found) {
+          foundKeyHex = Utils::bytesToHex(
+              std::vector<unsigned char>(s.key, s.key + sizeof(s.key)));
+        }
+      }
+      disconnect();
+      serverStopped = true;
+      if (onStop)
+        onStop();
+      return;
+    }
+
+    sentJumps = jumps;
+    batch.clear();
+
+    if (stop) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (pending.empty())
+        return;
+    }
+  }
+}
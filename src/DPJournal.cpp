@@ -0,0 +1,247 @@
+#include "DPJournal.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+static const char kJournalMagic[8] = {'S', 'K', 'G', 'R', 'O', 'O', 'J', 'L'};
+static const uint32_t kJournalVersion = 1;
+
+// Queued records that trigger a write before the flush interval
+static const size_t kBatchRecords = 4096;
+
+static JournalHeader makeHeader(const CheckpointHeader& identity) {
+  JournalHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kJournalMagic, sizeof(h.magic));
+  h.version = kJournalVersion;
+  h.recordSize = sizeof(CheckpointRecord);
+  std::memcpy(h.startRange, identity.startRange, sizeof(h.startRange));
+  std::memcpy(h.endRange, identity.endRange, sizeof(h.endRange));
+  std::memcpy(h.target, identity.target, sizeof(h.target));
+  h.flags = identity.flags;
+  return h;
+}
+
+static bool writeAll(int fd, const void* data, size_t len) {
+  const char* p = static_cast<const char*>(data);
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n < 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static void syncData(int fd) {
+#if defined(__APPLE__)
+  fsync(fd);
+#else
+  fdatasync(fd);
+#endif
+}
+
+DPJournal::DPJournal(const std::string& path, const CheckpointHeader& identity,
+                     size_t maxQueued)
+    : path(path), header(makeHeader(identity)), maxQueued(maxQueued) {
+  openFile();
+  writer = std::thread(&DPJournal::writerLoop, this);
+}
+
+DPJournal::~DPJournal() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cv.notify_one();
+  if (writer.joinable())
+    writer.join();
+  if (fd >= 0)
+    close(fd);
+}
+
+void DPJournal::openFile() {
+  size_t valid = scan(path, header, nullptr);
+  fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open DP journal: " + path);
+
+  // Drop a torn tail (or a foreign journal) before appending
+  if (ftruncate(fd, (off_t)valid) != 0 ||
+      lseek(fd, 0, SEEK_END) != (off_t)valid ||
+      (valid == 0 && !writeAll(fd, &header, sizeof(header)))) {
+    close(fd);
+    fd = -1;
+    throw std::runtime_error("Failed to open DP journal: " + path);
+  }
+  syncData(fd);
+}
+
+bool DPJournal::append(const CheckpointRecord& record) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.size() >= maxQueued) {
+      droppedCount++;
+      return false;
+    }
+    queue.push_back(record);
+    wake = queue.size() == kBatchRecords;
+  }
+  if (wake)
+    cv.notify_one();
+  return true;
+}
+
+void DPJournal::rotate() {
+  std::unique_lock<std::mutex> lock(mutex);
+  uint64_t request = ++rotateRequests;
+  cv.notify_one();
+  rotated.wait(lock, [&] { return rotateDone >= request || stopping; });
+}
+
+void DPJournal::commit() {
+  std::lock_guard<std::mutex> lock(mutex);
+  unlink((path + ".old").c_str());
+}
+
+void DPJournal::writerLoop() {
+  std::vector<CheckpointRecord> batch;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    cv.wait_for(lock, std::chrono::seconds(1), [&] {
+      return stopping || queue.size() >= kBatchRecords ||
+             rotateRequests > rotateDone;
+    });
+    batch.swap(queue);
+    uint64_t request = rotateRequests;
+    bool stop = stopping;
+
+    lock.unlock();
+    writeBatch(batch);
+    batch.clear();
+
+    if (request > rotateDone) {
+      // A pending .old is from a failed checkpoint: this snapshot covers
+      // it too, so keep it and go on appending to the current file.
+      struct stat st;
+      std::string old = path + ".old";
+      if (stat(old.c_str(), &st) != 0) {
+        close(fd);
+        fd = -1;
+        if (rename(path.c_str(), old.c_str()) != 0)
+          std::cerr << "Failed to rotate DP journal: " << path << std::endl;
+        try {
+          openFile();
+        } catch (const std::exception& e) {
+          std::cerr << e.what() << std::endl;
+        }
+      }
+    }
+    lock.lock();
+
+    if (request > rotateDone) {
+      rotateDone = request;
+      rotated.notify_all();
+    }
+    if (stop && queue.empty())
+      return;
+  }
+}
+
+void DPJournal::writeBatch(const std::vector<CheckpointRecord>& records) {
+  if (records.empty() || fd < 0)
+    return;
+
+  JournalBatch b;
+  b.count = (uint32_t)records.size();
+  b.reserved = 0;
+  b.checksum = Checkpoint::checksum(Checkpoint::kChecksumSeed, records.data(),
+                                    records.size() * sizeof(CheckpointRecord));
+  if (!writeAll(fd, &b, sizeof(b)) ||
+      !writeAll(fd, records.data(),
+                records.size() * sizeof(CheckpointRecord))) {
+    std::cerr << "Failed to write DP journal: " << path << std::endl;
+    return;
+  }
+  syncData(fd);
+}
+
+size_t DPJournal::scan(
+    const std::string& file, const JournalHeader& expected,
+    const std::function<void(const CheckpointRecord&)>& fn) {
+  FILE* f = fopen(file.c_str(), "rb");
+  if (!f)
+    return 0;
+  struct stat st;
+  if (fstat(fileno(f), &st) != 0) {
+    fclose(f);
+    return 0;
+  }
+
+  JournalHeader h;
+  if (fread(&h, sizeof(h), 1, f) != 1 ||
+      std::memcmp(&h, &expected, sizeof(h)) != 0) {
+    fclose(f);
+    return 0;
+  }
+
+  size_t valid = sizeof(h);
+  std::vector<CheckpointRecord> records;
+  JournalBatch b;
+  while (fread(&b, sizeof(b), 1, f) == 1) {
+    size_t left = (size_t)st.st_size - valid - sizeof(b);
+    if (b.count > left / sizeof(CheckpointRecord))
+      break;  // Torn write
+    records.resize(b.count);
+    if (fread(records.data(), sizeof(CheckpointRecord), b.count, f) !=
+            b.count ||
+        Checkpoint::checksum(Checkpoint::kChecksumSeed, records.data(),
+                             b.count * sizeof(CheckpointRecord)) !=
+            b.checksum) {
+      break;  // Torn write
+    }
+    if (fn) {
+      for (const CheckpointRecord& r : records)
+        fn(r);
+    }
+    valid += sizeof(b) + b.count * sizeof(CheckpointRecord);
+  }
+  fclose(f);
+  return valid;
+}
+
+size_t DPJournal::pendingRecords(const std::string& path) {
+  size_t bytes = 0;
+  struct stat st;
+  if (stat((path + ".old").c_str(), &st) == 0)
+    bytes += (size_t)st.st_size;
+  if (stat(path.c_str(), &st) == 0)
+    bytes += (size_t)st.st_size;
+  return bytes / sizeof(CheckpointRecord);
+}
+
+size_t DPJournal::replay(
+    const std::string& path, const CheckpointHeader& identity,
+    const std::function<void(const CheckpointRecord&)>& fn) {
+  return replayFile(path + ".old", identity, fn) +
+         replayFile(path, identity, fn);
+}
+
+size_t DPJournal::replayFile(
+    const std::string& file, const CheckpointHeader& identity,
+    const std::function<void(const CheckpointRecord&)>& fn) {
+  size_t count = 0;
+  scan(file, makeHeader(identity), [&](const CheckpointRecord& r) {
+    fn(r);
+    count++;
+  });
+  return count;
+}
@@ -0,0 +1,197 @@
+#include "DPServer.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "DPProtocol.hpp"
+
+static_assert(sizeof(DPProtocol::Stop) == 40, "Stop message layout");
+
+// A connection that sends no Hello within this many seconds is dropped
+static const int kHelloTimeoutSeconds = 10;
+
+DPServer::DPServer(int port, const CheckpointHeader& config,
+                   const std::vector<unsigned char>& jumps,
+                   std::function<void(const DPRecord&)> ingest,
+                   std::function<void(uint64_t)> addJumps)
+    : port(port), ingest(ingest), addJumps(addJumps) {
+  configPayload.resize(sizeof(config) + jumps.size());
+  std::memcpy(configPayload.data(), &config, sizeof(config));
+  std::memcpy(configPayload.data() + sizeof(config), jumps.data(),
+              jumps.size());
+  std::memset(stopPayload, 0, sizeof(stopPayload));
+}
+
+DPServer::~DPServer() {
+  stop(false, nullptr);
+}
+
+void DPServer::start() {
+  listenFd = DPProtocol::listenOn(port);
+  if (listenFd < 0)
+    throw std::runtime_error("Cannot listen on port " + std::to_string(port));
+  acceptor = std::thread(&DPServer::acceptLoop, this);
+}
+
+void DPServer::stop(bool found, const unsigned char* key) {
+  if (!stopping) {
+    DPProtocol::Stop s;
+    std::memset(&s, 0, sizeof(s));
+    s.found = found ? 1 : 0;
+    if (found && key)
+      std::memcpy(s.key, key, sizeof(s.key));
+    std::memcpy(stopPayload, &s, sizeof(s));
+    stopping = true;
+
+    // Workers send a batch at least every second: let them hear about it
+    for (int i = 0; i < 30; i++) {
+      bool anyConnected = false;
+      {
+        std::lock_guard<std::mutex> lock(workersMutex);
+        for (auto& w : workers)
+          anyConnected = anyConnected || w->connected;
+      }
+      if (!anyConnected)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+
+  if (listenFd >= 0) {
+    shutdown(listenFd, SHUT_RDWR);
+    close(listenFd);
+    listenFd = -1;
+  }
+  if (acceptor.joinable())
+    acceptor.join();
+
+  std::lock_guard<std::mutex> lock(workersMutex);
+  for (auto& w : workers) {
+    shutdown(w->fd, SHUT_RDWR);
+    if (w->thread.joinable())
+      w->thread.join();
+    close(w->fd);
+  }
+  workers.clear();
+}
+
+void DPServer::acceptLoop() {
+  while (!stopping) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (stopping)
+        return;
+      continue;
+    }
+
+    std::lock_guard<std::mutex> lock(workersMutex);
+    if (stopping) {
+      close(fd);
+      return;
+    }
+    reapWorkers();
+    std::unique_ptr<Worker> w(new Worker());
+    w->fd = fd;
+    w->lastTime = std::chrono::steady_clock::now();
+    Worker* raw = w.get();
+    workers.push_back(std::move(w));
+    raw->thread = std::thread(&DPServer::serveWorker, this, raw);
+  }
+}
+
+void DPServer::reapWorkers() {
+  auto gone = [](const std::unique_ptr<Worker>& w) {
+    if (w->connected || w->lastJumps != w->jumps)
+      return false;
+    if (w->thread.joinable())
+      w->thread.join();
+    close(w->fd);
+    return true;
+  };
+  workers.erase(std::remove_if(workers.begin(), workers.end(), gone),
+                workers.end());
+}
+
+void DPServer::serveWorker(Worker* worker) {
+  uint32_t type;
+  std::vector<unsigned char> payload;
+
+  DPProtocol::Hello hello;
+  DPProtocol::setRecvTimeout(worker->fd, kHelloTimeoutSeconds);
+  if (!DPProtocol::recvFrame(worker->fd, type, payload) ||
+      type != DPProtocol::kHello || payload.size() != sizeof(hello)) {
+    shutdown(worker->fd, SHUT_RDWR);
+    worker->connected = false;
+    return;
+  }
+  DPProtocol::setRecvTimeout(worker->fd, 0);
+  std::memcpy(&hello, payload.data(), sizeof(hello));
+  hello.name[sizeof(hello.name) - 1] = 0;
+  worker->name = hello.name;
+  if (hello.version != DPProtocol::kVersion ||
+      !DPProtocol::sendFrame(worker->fd, DPProtocol::kConfig,
+                             configPayload.data(), configPayload.size())) {
+    shutdown(worker->fd, SHUT_RDWR);
+    worker->connected = false;
+    return;
+  }
+  std::cout << "\nWorker connected: " << worker->name << std::endl;
+
+  DPProtocol::BatchHeader bh;
+  while (DPProtocol::recvFrame(worker->fd, type, payload)) {
+    if (type != DPProtocol::kDPBatch || payload.size() < sizeof(bh))
+      break;
+    std::memcpy(&bh, payload.data(), sizeof(bh));
+    if (payload.size() != sizeof(bh) + bh.count * sizeof(CheckpointRecord))
+      break;
+
+    const unsigned char* p = payload.data() + sizeof(bh);
+    for (uint32_t i = 0; i < bh.count; i++) {
+      CheckpointRecord r;
+      std::memcpy(&r, p + i * sizeof(r), sizeof(r));
+      DPRecord dp = {r.fp, Checkpoint::distance(r), Checkpoint::tag(r)};
+      ingest(dp);
+    }
+    worker->dps += bh.count;
+    worker->jumps += bh.jumps;
+    addJumps(bh.jumps);
+
+    bool ok = stopping ? DPProtocol::sendFrame(worker->fd, DPProtocol::kStop,
+                                               stopPayload, sizeof(stopPayload))
+                       : DPProtocol::sendFrame(worker->fd, DPProtocol::kAck,
+                                               nullptr, 0);
+    if (!ok || stopping)
+      break;
+  }
+
+  shutdown(worker->fd, SHUT_RDWR);
+  worker->connected = false;
+  if (!stopping)
+    std::cout << "\nWorker disconnected: " << worker->name << std::endl;
+}
+
+void DPServer::printStats(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(workersMutex);
+  auto now = std::chrono::steady_clock::now();
+  for (auto& w : workers) {
+    if (!w->connected && w->lastJumps == w->jumps)
+      continue;
+    uint64_t jumps = w->jumps;
+    double secs = std::chrono::duration<double>(now - w->lastTime).count();
+    double rate = secs > 0 ? (double)(jumps - w->lastJumps) / secs : 0;
+    w->lastJumps = jumps;
+    w->lastTime = now;
+
+    out << "  " << std::setw(20) << std::left << w->name << std::right
+        << (w->connected ? "" : " (gone)") << " DPs: " << w->dps
+        << " | Jumps: " << jumps << " | Rate: " << std::fixed
+        << std::setprecision(2) << rate / 1000000.0 << " M/jumps/s"
+        << std::endl;
+  }
+}
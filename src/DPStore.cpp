@@ -0,0 +1,435 @@
+#include "DPStore.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#include "Checkpoint.hpp"
+
+namespace {
+
+const int kBloomHashes = 7;
+const size_t kMergeWays = 4;
+// Records per write, and per read of a merge or a scan
+const size_t kBuffer = 4096;
+
+bool byFingerprint(const CheckpointRecord& a, const CheckpointRecord& b) {
+  return a.fp < b.fp;
+}
+
+size_t floorPow2(size_t n) {
+  size_t p = 1;
+  while (p * 2 <= n)
+    p *= 2;
+  return p;
+}
+
+}  // namespace
+
+// A sorted, immutable file of records with its Bloom filter and fences in
+// memory. The file goes with the last reference to the run.
+struct DPStore::Run {
+  std::string path;
+  int fd = -1;
+  size_t count = 0;
+  std::vector<uint64_t> bloom;
+  std::vector<uint64_t> fences;  // Fingerprint of every kFence-th record
+  std::vector<CheckpointRecord> pending;
+  bool ok = true;
+
+  // Opens a run for 'expected' records, appended in fingerprint order
+  Run(const std::string& path, size_t expected) : path(path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ok = fd >= 0;
+    bloom.assign(std::max<size_t>(1, (expected * kBloomBits + 63) / 64), 0);
+    pending.reserve(kBuffer);
+  }
+
+  ~Run() {
+    if (fd >= 0) {
+      close(fd);
+      unlink(path.c_str());
+    }
+  }
+
+  template <class F>
+  void forEachBit(uint64_t fp, F f) const {
+    uint64_t bits = bloom.size() * 64;
+    uint64_t step = (fp >> 32 | fp << 32) | 1;
+    for (int i = 0; i < kBloomHashes; i++)
+      f((fp + i * step) % bits);
+  }
+
+  void append(const CheckpointRecord& r) {
+    if (count % kFence == 0)
+      fences.push_back(r.fp);
+    forEachBit(r.fp, [&](uint64_t b) { bloom[b / 64] |= 1ULL << (b % 64); });
+    pending.push_back(r);
+    count++;
+    if (pending.size() == kBuffer)
+      writePending();
+  }
+
+  // True once every record is on disk
+  bool seal() {
+    writePending();
+    pending = std::vector<CheckpointRecord>();
+    return ok;
+  }
+
+  void writePending() {
+    const char* p = reinterpret_cast<const char*>(pending.data());
+    size_t len = pending.size() * sizeof(CheckpointRecord);
+    while (ok && len > 0) {
+      ssize_t n = ::write(fd, p, len);
+      if (n < 0 && errno != EINTR)
+        ok = false;
+      if (n > 0) {
+        p += n;
+        len -= (size_t)n;
+      }
+    }
+    pending.clear();
+  }
+
+  // Records [first, first + n)
+  bool read(size_t first, size_t n, CheckpointRecord* out) const {
+    char* p = reinterpret_cast<char*>(out);
+    size_t len = n * sizeof(CheckpointRecord);
+    off_t at = (off_t)(first * sizeof(CheckpointRecord));
+    while (len > 0) {
+      ssize_t got = pread(fd, p, len, at);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        return false;
+      p += got;
+      at += got;
+      len -= (size_t)got;
+    }
+    return true;
+  }
+
+  bool find(uint64_t fp, DPTable::Match* other) const {
+    bool maybe = count > 0;
+    forEachBit(fp, [&](uint64_t b) {
+      maybe = maybe && (bloom[b / 64] >> (b % 64) & 1);
+    });
+    if (!maybe)
+      return false;
+
+    auto fence = std::upper_bound(fences.begin(), fences.end(), fp);
+    if (fence == fences.begin())
+      return false;
+    size_t first = (size_t)(fence - fences.begin() - 1) * kFence;
+    size_t n = std::min(kFence, count - first);
+    CheckpointRecord block[kFence];
+    if (!read(first, n, block))
+      return false;
+    CheckpointRecord key;
+    key.fp = fp;
+    const CheckpointRecord* r =
+        std::lower_bound(block, block + n, key, byFingerprint);
+    if (r == block + n || r->fp != fp)
+      return false;
+    if (other) {
+      other->dist = Checkpoint::distance(*r);
+      other->tag = Checkpoint::tag(*r);
+    }
+    return true;
+  }
+
+  template <class F>
+  void scan(F f) const {
+    std::vector<CheckpointRecord> block(kBuffer);
+    for (size_t i = 0; i < count; i += kBuffer) {
+      size_t n = std::min(kBuffer, count - i);
+      if (!read(i, n, block.data()))
+        return;
+      for (size_t j = 0; j < n; j++)
+        f(block[j]);
+    }
+  }
+
+  // The table's records, sorted; null if they could not be written
+  static std::shared_ptr<Run> fromTable(const std::string& path,
+                                        const DPTable& table) {
+    std::vector<CheckpointRecord> records;
+    records.reserve(table.size());
+    table.forEach([&](uint64_t fp, const DPDistance& d, uint16_t tag) {
+      records.push_back(Checkpoint::pack(fp, d, tag));
+    });
+    std::sort(records.begin(), records.end(), byFingerprint);
+
+    std::shared_ptr<Run> run = std::make_shared<Run>(path, records.size());
+    for (const CheckpointRecord& r : records)
+      run->append(r);
+    return run->seal() ? run : nullptr;
+  }
+
+  // The inputs' records in one run, each fingerprint once
+  static std::shared_ptr<Run> merge(
+      const std::string& path,
+      const std::vector<std::shared_ptr<Run>>& inputs) {
+    struct Cursor {
+      const Run* run;
+      size_t next = 0;  // First record not yet in 'block'
+      std::vector<CheckpointRecord> block;
+      size_t pos = 0;
+
+      bool valid() const {
+        return pos < block.size();
+      }
+      uint64_t head() const {
+        return block[pos].fp;
+      }
+      bool refill() {
+        size_t n = std::min(kBuffer, run->count - next);
+        block.resize(n);
+        pos = 0;
+        if (n > 0 && !run->read(next, n, block.data()))
+          return false;
+        next += n;
+        return true;
+      }
+    };
+
+    size_t total = 0;
+    std::vector<Cursor> cursors(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+      cursors[i].run = inputs[i].get();
+      if (!cursors[i].refill())
+        return nullptr;
+      total += inputs[i]->count;
+    }
+
+    std::shared_ptr<Run> run = std::make_shared<Run>(path, total);
+    uint64_t last = 0;  // Fingerprints are never 0
+    for (;;) {
+      Cursor* low = nullptr;
+      for (Cursor& c : cursors) {
+        if (c.valid() && (!low || c.head() < low->head()))
+          low = &c;
+      }
+      if (!low)
+        break;
+      const CheckpointRecord& r = low->block[low->pos];
+      if (r.fp != last)
+        run->append(r);
+      last = r.fp;
+      if (++low->pos == low->block.size() && !low->refill())
+        return nullptr;
+    }
+    return run->seal() ? run : nullptr;
+  }
+};
+
+DPStore::DPStore(size_t capacity, size_t memoryLimit, const std::string& dir)
+    : memoryLimit(memoryLimit), dir(dir) {
+  tableEntries = 1024;
+  while (tableEntries < capacity)
+    tableEntries <<= 1;
+
+  if (memoryLimit > 0) {
+    // Two tables and a flush's sorted copy of one
+    size_t fits = floorPow2(memoryLimit / (3 * sizeof(CheckpointRecord)));
+    if (fits < 1024)
+      throw std::runtime_error("DP memory limit too small");
+    tableEntries = std::min(tableEntries, fits);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      throw std::runtime_error("Failed to create DP run directory: " + dir);
+  }
+  active = std::make_shared<DPTable>(tableEntries);
+
+  if (memoryLimit > 0) {
+    flusher = std::thread(&DPStore::flushLoop, this);
+    merger = std::thread(&DPStore::mergeLoop, this);
+  }
+}
+
+DPStore::~DPStore() {
+  if (!spills())
+    return;
+  {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    stopping = true;
+  }
+  cv.notify_all();
+  flusher.join();
+  merger.join();
+  runs.clear();
+  rmdir(dir.c_str());  // Fails, harmlessly, if others' runs are in it
+}
+
+DPTable::InsertResult DPStore::insert(uint64_t fp, const DPDistance& dist,
+                                      uint16_t tag, DPTable::Match* other,
+                                      uint64_t* probes) {
+  if (!spills())
+    return active->insert(fp, dist, tag, other, probes);
+
+  for (;;) {
+    const DPTable* full;
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex);
+      if (frozen && frozen->find(fp, other))
+        return DPTable::InsertResult::Matched;
+      for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+        if ((*it)->find(fp, other))
+          return DPTable::InsertResult::Matched;
+      }
+      DPTable::InsertResult result =
+          active->insert(fp, dist, tag, other, probes);
+      if (result != DPTable::InsertResult::Full || writeFailed)
+        return result;
+      full = active.get();
+    }
+    rotate(full);
+  }
+}
+
+void DPStore::rotate(const DPTable* full) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  // One frozen table at a time: the memory budget holds two
+  cv.wait(lock, [&] {
+    return active.get() != full || !frozen || writeFailed || stopping;
+  });
+  if (active.get() != full || writeFailed || stopping)
+    return;
+  frozen = std::move(active);
+  active = std::make_shared<DPTable>(tableEntries);
+  cv.notify_all();
+}
+
+std::string DPStore::runPath() {
+  return dir + "/run-" + std::to_string(nextRun++);
+}
+
+void DPStore::flushLoop() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  for (;;) {
+    cv.wait(lock, [&] { return stopping || (frozen && !writeFailed); });
+    if (stopping)
+      return;
+    std::shared_ptr<DPTable> table = frozen;
+    std::string path = runPath();
+    lock.unlock();
+
+    // The frozen table answers lookups until its run replaces it
+    std::shared_ptr<Run> run = Run::fromTable(path, *table);
+    lock.lock();
+    if (run) {
+      runs.push_back(run);
+      spilledCount += run->count;
+      frozen.reset();
+    } else {
+      // Keep the table in memory; later DPs are dropped as if it were full
+      writeFailed = true;
+      std::cerr << "Failed to write DP run: " << path << std::endl;
+    }
+    cv.notify_all();
+  }
+}
+
+int DPStore::mergeable() const {
+  // Size classes: runs of one flush, of four, of sixteen...
+  size_t flush = std::max<size_t>(1, tableEntries - tableEntries / 8);
+  auto sizeClass = [&](const Run& r) {
+    int c = 0;
+    for (size_t n = r.count / flush; n >= kMergeWays; n /= kMergeWays)
+      c++;
+    return c;
+  };
+  for (size_t i = 0; i + kMergeWays <= runs.size(); i++) {
+    int c = sizeClass(*runs[i]);
+    size_t j = 1;
+    while (j < kMergeWays && sizeClass(*runs[i + j]) == c)
+      j++;
+    if (j == kMergeWays)
+      return (int)i;
+  }
+  return -1;
+}
+
+void DPStore::mergeLoop() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  for (;;) {
+    int first = -1;
+    cv.wait(lock, [&] { return stopping || (first = mergeable()) >= 0; });
+    if (stopping)
+      return;
+    std::vector<std::shared_ptr<Run>> inputs(
+        runs.begin() + first, runs.begin() + first + kMergeWays);
+    std::string path = runPath();
+    lock.unlock();
+
+    // The inputs answer lookups until the merged run replaces them
+    std::shared_ptr<Run> merged = Run::merge(path, inputs);
+    lock.lock();
+    if (!merged) {
+      std::cerr << "Failed to merge DP runs into " << path
+                << " (runs are no longer merged)" << std::endl;
+      return;
+    }
+    // Flushes only append, so the inputs are still in a row
+    auto at = std::find(runs.begin(), runs.end(), inputs[0]);
+    at = runs.erase(at, at + kMergeWays);
+    runs.insert(at, merged);
+    size_t inputCount = 0;
+    for (const auto& r : inputs)
+      inputCount += r->count;
+    spilledCount -= inputCount - merged->count;
+    cv.notify_all();
+  }
+}
+
+size_t DPStore::size() const {
+  if (!spills())
+    return active->size();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return active->size() + (frozen ? frozen->size() : 0) + spilled();
+}
+
+size_t DPStore::memoryBytes() const {
+  return active->memoryBytes() * (spills() ? 2 : 1);
+}
+
+size_t DPStore::runCount() const {
+  if (!spills())
+    return 0;
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return runs.size();
+}
+
+void DPStore::forEach(
+    const std::function<void(uint64_t fp, const DPDistance& dist,
+                             uint16_t tag)>& fn) const {
+  if (!spills()) {
+    active->forEach(fn);
+    return;
+  }
+
+  // The tiers as they are now; each one only grows or stays as it is
+  std::shared_ptr<DPTable> tables[2];
+  std::vector<std::shared_ptr<Run>> spilledRuns;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    tables[0] = active;
+    tables[1] = frozen;
+    spilledRuns = runs;
+  }
+  for (const auto& t : tables) {
+    if (t)
+      t->forEach(fn);
+  }
+  for (const auto& run : spilledRuns) {
+    run->scan([&](const CheckpointRecord& r) {
+      fn(r.fp, Checkpoint::distance(r), Checkpoint::tag(r));
+    });
+  }
+}
@@ -0,0 +1,111 @@
+#include "DPTable.hpp"
+
+#include <thread>
+
+static_assert(sizeof(DPDistance) * 8 >= DPTable::kDistanceBits,
+              "DPDistance narrower than the table distances");
+
+DPTable::DPTable(size_t capacity) {
+  size_t n = 1024;
+  while (n < capacity)
+    n <<= 1;
+  entries.reset(new Entry[n]);
+  mask = n - 1;
+  loadLimit = n - n / 8;  // Keep probe chains short
+}
+
+uint64_t DPTable::fingerprint(const FieldElement& x) {
+  // The low bits of x.v[0] are zero for every DP; mix in the other limbs
+  uint64_t h = x.v[1] ^ (x.v[2] * 0x9E3779B97F4A7C15ULL) ^ (x.v[0] >> 32);
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return h < 2 ? h + 2 : h;  // 0 and 1 mark free / busy slots
+}
+
+DPTable::InsertResult DPTable::insert(uint64_t fp, const DPDistance& dist,
+                                      uint16_t tag, Match* other,
+                                      uint64_t* probes) {
+  size_t i = (size_t)fp & mask;
+  for (;;) {
+    Entry& e = entries[i];
+    if (probes)
+      (*probes)++;
+    uint64_t cur = e.fp.load(std::memory_order_acquire);
+
+    if (cur == kEmpty) {
+      if (count.load(std::memory_order_relaxed) >= loadLimit)
+        return InsertResult::Full;
+      if (!e.fp.compare_exchange_strong(cur, kBusy,
+                                        std::memory_order_acquire)) {
+        continue;  // Lost the race, re-read this slot
+      }
+      e.dist[0] = dist.v[0];
+      e.dist[1] = dist.v[1];
+      e.distHiTag = (dist.v[2] & 0xFFFFFFFFFFFFULL) | ((uint64_t)tag << 48);
+      e.fp.store(fp, std::memory_order_release);
+      count.fetch_add(1, std::memory_order_relaxed);
+      return InsertResult::Inserted;
+    }
+
+    if (cur == kBusy) {
+      // Another thread is filling the slot; it may hold our fingerprint
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (cur == fp) {
+      if (other) {
+        other->dist = DPDistance::zero();
+        other->dist.v[0] = e.dist[0];
+        other->dist.v[1] = e.dist[1];
+        other->dist.v[2] = e.distHiTag & 0xFFFFFFFFFFFFULL;
+        other->tag = (uint16_t)(e.distHiTag >> 48);
+      }
+      return InsertResult::Matched;
+    }
+
+    i = (i + 1) & mask;
+  }
+}
+
+bool DPTable::find(uint64_t fp, Match* other) const {
+  size_t i = (size_t)fp & mask;
+  for (;;) {
+    const Entry& e = entries[i];
+    uint64_t cur = e.fp.load(std::memory_order_acquire);
+    if (cur == kEmpty)
+      return false;
+    if (cur == kBusy) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (cur == fp) {
+      if (other) {
+        other->dist = DPDistance::zero();
+        other->dist.v[0] = e.dist[0];
+        other->dist.v[1] = e.dist[1];
+        other->dist.v[2] = e.distHiTag & 0xFFFFFFFFFFFFULL;
+        other->tag = (uint16_t)(e.distHiTag >> 48);
+      }
+      return true;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+void DPTable::forEach(
+    const std::function<void(uint64_t fp, const DPDistance& dist,
+                             uint16_t tag)>& fn) const {
+  for (size_t i = 0; i <= mask; i++) {
+    const Entry& e = entries[i];
+    uint64_t fp = e.fp.load(std::memory_order_acquire);
+    if (fp == kEmpty || fp == kBusy)
+      continue;
+    DPDistance dist = DPDistance::zero();
+    dist.v[0] = e.dist[0];
+    dist.v[1] = e.dist[1];
+    dist.v[2] = e.distHiTag & 0xFFFFFFFFFFFFULL;
+    fn(fp, dist, (uint16_t)(e.distHiTag >> 48));
+  }
+}
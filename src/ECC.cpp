@@ -48,3 +48,19 @@ bool ECC::getPubKeyFromPriv(secp256k1_pubkey& pubkey, const unsigned char* privK
     return secp256k1_ec_pubkey_create(ctx, &pubkey, privKey) == 1;
 }
 
+
+AffinePoint ECC::toAffine(const secp256k1_pubkey& pubkey) {
+    std::vector<unsigned char> ser = serializePublicKey(pubkey, false);
+    AffinePoint point;
+    point.x = FieldElement::fromBytes(ser.data() + 1);
+    point.y = FieldElement::fromBytes(ser.data() + 33);
+    return point;
+}
+
+bool ECC::fromAffine(secp256k1_pubkey& pubkey, const AffinePoint& point) {
+    std::vector<unsigned char> ser(65);
+    ser[0] = 0x04;
+    point.x.toBytes(ser.data() + 1);
+    point.y.toBytes(ser.data() + 33);
+    return parsePublicKey(pubkey, ser);
+}
@@ -0,0 +1,142 @@
+#include "FieldElement.hpp"
+
+FieldElement FieldElement::fromBytes(const unsigned char* bytes) {
+  FieldElement r;
+  for (int i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (int j = 0; j < 8; j++) {
+      limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+    }
+    r.v[i] = limb;
+  }
+  return r;
+}
+
+void FieldElement::toBytes(unsigned char* bytes) const {
+  for (int i = 0; i < 4; i++) {
+    uint64_t limb = v[3 - i];
+    for (int j = 7; j >= 0; j--) {
+      bytes[i * 8 + j] = (unsigned char)limb;
+      limb >>= 8;
+    }
+  }
+}
+
+namespace Field {
+
+static void sqrN(FieldElement& r, const FieldElement& a, int n) {
+  r = a;
+  for (int i = 0; i < n; i++)
+    sqr(r, r);
+}
+
+void inv(FieldElement& r, const FieldElement& a) {
+  // Addition chain for p - 2 (same as libsecp256k1): blocks of ones of
+  // lengths 1, 2, 22 and 223 in the exponent.
+  FieldElement x2, x3, x6, x9, x11, x22, x44, x88, x176, x220, x223, t;
+
+  sqr(x2, a);
+  mul(x2, x2, a);
+
+  sqr(x3, x2);
+  mul(x3, x3, a);
+
+  sqrN(x6, x3, 3);
+  mul(x6, x6, x3);
+
+  sqrN(x9, x6, 3);
+  mul(x9, x9, x3);
+
+  sqrN(x11, x9, 2);
+  mul(x11, x11, x2);
+
+  sqrN(x22, x11, 11);
+  mul(x22, x22, x11);
+
+  sqrN(x44, x22, 22);
+  mul(x44, x44, x22);
+
+  sqrN(x88, x44, 44);
+  mul(x88, x88, x44);
+
+  sqrN(x176, x88, 88);
+  mul(x176, x176, x88);
+
+  sqrN(x220, x176, 44);
+  mul(x220, x220, x44);
+
+  sqrN(x223, x220, 3);
+  mul(x223, x223, x3);
+
+  sqrN(t, x223, 23);
+  mul(t, t, x22);
+  sqrN(t, t, 5);
+  mul(t, t, a);
+  sqrN(t, t, 3);
+  mul(t, t, x2);
+  sqrN(t, t, 2);
+  mul(r, t, a);
+}
+
+void batchInverse(FieldElement* a, size_t n, FieldElement* scratch) {
+  if (n == 0)
+    return;
+
+  // Prefix products: scratch[i] = a[0] * ... * a[i]
+  scratch[0] = a[0];
+  for (size_t i = 1; i < n; i++)
+    mul(scratch[i], scratch[i - 1], a[i]);
+
+  FieldElement acc;
+  inv(acc, scratch[n - 1]);
+
+  // Walk back: acc = (a[0] * ... * a[i])^-1 at the top of each iteration
+  for (size_t i = n - 1; i > 0; i--) {
+    FieldElement t;
+    mul(t, acc, scratch[i - 1]);
+    mul(acc, acc, a[i]);
+    a[i] = t;
+  }
+  a[0] = acc;
+}
+
+bool addPoints(AffinePoint& p, const AffinePoint& q) {
+  FieldElement dx;
+  sub(dx, q.x, p.x);
+
+  if (!dx.isZero()) {
+    FieldElement invDx;
+    inv(invDx, dx);
+    addWithInverse(p, q, invDx);
+    return true;
+  }
+
+  if (p.y != q.y || p.y.isZero()) {
+    return false;  // P == -Q
+  }
+
+  // Doubling: lambda = 3x^2 / 2y
+  FieldElement lambda, t, x3;
+  sqr(t, p.x);
+  add(lambda, t, t);
+  add(lambda, lambda, t);
+  add(t, p.y, p.y);
+  inv(t, t);
+  mul(lambda, lambda, t);
+
+  sqr(x3, lambda);
+  sub(x3, x3, p.x);
+  sub(x3, x3, p.x);
+  sub(t, p.x, x3);
+  mul(t, lambda, t);
+  sub(p.y, t, p.y);
+  p.x = x3;
+  return true;
+}
+
+void toCompressed(const AffinePoint& p, unsigned char* out) {
+  out[0] = p.y.isOdd() ? 0x03 : 0x02;
+  p.x.toBytes(out + 1);
+}
+
+}  // namespace Field
@@ -0,0 +1,149 @@
+#include "HerdStart.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "HerdStepper.hpp"
+#include "Utils.hpp"
+
+namespace {
+
+const mpz_class kOrder(
+    "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141", 16);
+// Draws of a start before giving up on the range
+const int kTries = 64;
+
+// Uniform in [0, limit), rounded down to even if 'even'
+mpz_class draw(gmp_randclass& rr, const mpz_class& limit, bool even) {
+  mpz_class o = rr.get_z_range(limit > 0 ? limit : mpz_class(1));
+  if (even)
+    o -= o % 2;
+  return o;
+}
+
+}  // namespace
+
+mpz_class HerdStart::scalarAt(const mpz_class& offset) const {
+  mpz_class s = (base + offset) % kOrder;
+  if (s < 0)
+    s += kOrder;
+  return s;
+}
+
+bool HerdStart::pointAt(ECC& ecc, const mpz_class& offset,
+                        AffinePoint& point) const {
+  mpz_class s = scalarAt(offset);
+  unsigned char scalar[32];
+  Utils::mpzToBytes(s.get_mpz_t(), scalar);
+
+  secp256k1_pubkey p;
+  if (anchor) {
+    p = *anchor;
+    if (!ecc.addScalar(p, scalar))
+      return false;
+  } else if (s == 0 || !ecc.getPubKeyFromPriv(p, scalar)) {
+    return false;
+  }
+  point = ecc.toAffine(p);
+  return true;
+}
+
+AffinePoint HerdStart::spawn(ECC& ecc, gmp_randclass& rr,
+                             Distance<4>& offset) const {
+  AffinePoint point;
+  for (int i = 0; i < kTries; i++) {
+    mpz_class o = draw(rr, spread, even);
+    if (pointAt(ecc, o, point)) {
+      offset = Distance<4>::fromMpz(o);
+      return point;
+    }
+  }
+  throw std::runtime_error("No kangaroo start in the range");
+}
+
+bool HerdStart::fill(size_t count, uint64_t seed, AffinePoint* points,
+                     Distance<4>* offsets) const {
+  if (count == 0)
+    return true;
+  gmp_randclass rr(gmp_randinit_default);
+  rr.seed(mpz_class((unsigned long)seed));
+
+  size_t lanes = std::min(count, (size_t)kLanes);
+  size_t steps = (count + lanes - 1) / lanes;
+
+  // Strides in [1, 2 * mean] (doubled for even offsets)
+  int unit = even ? 2 : 1;
+  mpz_class mean = spread / (unsigned long)count / unit;
+  if (mean < 1)
+    mean = 1;
+  ECC ecc;
+  std::vector<AffinePoint> stridePoints(kStrides);
+  std::vector<Distance<4>> strides(kStrides);
+  for (int i = 0; i < kStrides; i++) {
+    mpz_class s = (rr.get_z_range(2 * mean) + 1) * unit;
+    strides[i] = Distance<4>::fromMpz(s);
+    unsigned char scalar[32];
+    Utils::mpzToBytes(s.get_mpz_t(), scalar);
+    secp256k1_pubkey p;
+    ecc.getPubKeyFromPriv(p, scalar);
+    stridePoints[i] = ecc.toAffine(p);
+  }
+
+  // Walks start low enough to end within the spread, on average
+  mpz_class room = spread - mean * unit * (unsigned long)(steps - 1);
+  // Without an anchor, redraw starts at 0 (the point at infinity)
+  std::vector<mpz_class> laneStarts(lanes);
+  for (size_t j = 0; j < lanes; j++) {
+    for (int i = 0; i < kTries; i++) {
+      laneStarts[j] = draw(rr, room, even);
+      if (anchor || scalarAt(laneStarts[j]) != 0)
+        break;
+    }
+  }
+
+  // Blocks of walks, each sharing its inversions. Walk j gives kangaroos
+  // [j * steps, (j + 1) * steps).
+  const size_t block = 64;
+  long blocks = (long)((lanes + block - 1) / block);
+  int failed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(| : failed)
+  for (long b = 0; b < blocks; b++) {
+    size_t first = (size_t)b * block;
+    int n = (int)std::min(block, lanes - first);
+    ECC local;
+    HerdStepper stepper(stridePoints.data(), kStrides);
+    std::vector<AffinePoint> walk(n);
+    std::vector<Distance<4>> walked(n);
+    std::vector<int> strideIdx(n);
+    bool ok = true;
+    for (int k = 0; k < n && ok; k++) {
+      ok = pointAt(local, laneStarts[first + k], walk[k]);
+      walked[k] = Distance<4>::fromMpz(laneStarts[first + k]);
+    }
+    if (!ok) {
+      failed = 1;
+      continue;
+    }
+
+    for (size_t s = 0; s < steps; s++) {
+      for (int k = 0; k < n; k++) {
+        size_t i = (first + k) * steps + s;
+        if (i < count) {
+          points[i] = walk[k];
+          offsets[i] = walked[k];
+        }
+      }
+      // Done once the block's first walk has given its last start
+      if (s + 1 == steps || first * steps + s + 1 >= count)
+        break;
+      if (!stepper.step(walk.data(), n, strideIdx.data())) {
+        failed = 1;
+        break;
+      }
+      for (int k = 0; k < n; k++)
+        walked[k] += strides[strideIdx[k]];
+    }
+  }
+  return !failed;
+}
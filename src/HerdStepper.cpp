@@ -0,0 +1,109 @@
+#include "HerdStepper.hpp"
+
+#include <stdexcept>
+
+struct HerdStepper::Kernel {
+  const char* name;
+  int lanes;
+  bool (*step)(const HerdKernel::Args& args);
+};
+
+HerdStepper::HerdStepper(const AffinePoint* jumps, int tableSize)
+    : jumps(jumps), tableSize(tableSize) {
+  if (tableSize <= 0 || (tableSize & (tableSize - 1)) != 0) {
+    throw std::runtime_error("Jump table size must be a power of 2");
+  }
+
+  kernel = selectKernel();
+  if (!kernel)
+    return;
+  lanes = kernel->lanes;
+
+  jumpX52.resize(5 * (size_t)tableSize);
+  jumpY52.resize(5 * (size_t)tableSize);
+  const uint64_t m52 = (1ULL << 52) - 1;
+  for (int i = 0; i < tableSize; i++) {
+    const FieldElement* coords[2] = {&jumps[i].x, &jumps[i].y};
+    uint64_t* out[2] = {jumpX52.data(), jumpY52.data()};
+    for (int c = 0; c < 2; c++) {
+      const uint64_t* v = coords[c]->v;
+      out[c][0 * (size_t)tableSize + i] = v[0] & m52;
+      out[c][1 * (size_t)tableSize + i] = ((v[0] >> 52) | (v[1] << 12)) & m52;
+      out[c][2 * (size_t)tableSize + i] = ((v[1] >> 40) | (v[2] << 24)) & m52;
+      out[c][3 * (size_t)tableSize + i] = ((v[2] >> 28) | (v[3] << 36)) & m52;
+      out[c][4 * (size_t)tableSize + i] = v[3] >> 16;
+    }
+  }
+}
+
+const char* HerdStepper::isaName() const {
+  return kernel ? kernel->name : "scalar";
+}
+
+bool HerdStepper::step(AffinePoint* points, int n, int* jumpIdx) {
+  if (kernel && n >= lanes && n % lanes == 0) {
+    if (work.size() < 10 * (size_t)n)
+      work.resize(10 * (size_t)n);
+
+    HerdKernel::Args args;
+    args.jumpX = jumpX52.data();
+    args.jumpY = jumpY52.data();
+    args.tableSize = tableSize;
+    args.points = points;
+    args.n = n;
+    args.jumpIdx = jumpIdx;
+    args.work = work.data();
+    if (kernel->step(args))
+      return true;
+    // Some P.x == Jump.x: the scalar path handles doubling / infinity
+  }
+  return stepScalar(points, n, jumpIdx);
+}
+
+bool HerdStepper::stepScalar(AffinePoint* points, int n, int* jumpIdx) {
+  if (dx.size() < (size_t)n) {
+    dx.resize(n);
+    scratch.resize(n);
+  }
+
+  bool degenerate = false;
+  for (int k = 0; k < n; k++) {
+    jumpIdx[k] = jumpIndex(points[k].x, tableSize);
+    Field::sub(dx[k], jumps[jumpIdx[k]].x, points[k].x);
+    if (dx[k].isZero()) {
+      dx[k] = FieldElement::one();  // Patched up below
+      degenerate = true;
+    }
+  }
+
+  Field::batchInverse(dx.data(), n, scratch.data());
+
+  bool ok = true;
+  for (int k = 0; k < n; k++) {
+    const AffinePoint& jump = jumps[jumpIdx[k]];
+    if (degenerate && points[k].x == jump.x) {
+      // P == +-Jump: only possible with a degenerate range
+      if (!Field::addPoints(points[k], jump))
+        ok = false;
+    } else {
+      Field::addWithInverse(points[k], jump, dx[k]);
+    }
+  }
+  return ok;
+}
+
+const HerdStepper::Kernel* HerdStepper::selectKernel() {
+#if defined(SILIKANGAROO_X86_SIMD)
+  static const HerdStepper::Kernel avx512 = {"avx512ifma", 8,
+                                             HerdKernel::stepAvx512Ifma};
+  static const HerdStepper::Kernel avx2 = {"avx2", 4, HerdKernel::stepAvx2};
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512ifma"))
+    return &avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return &avx2;
+#endif
+  return nullptr;
+}
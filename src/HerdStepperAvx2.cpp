@@ -0,0 +1,87 @@
+// Built with -mavx2 on x86-64 (see CMakeLists.txt)
+#include "HerdStepperKernel.hpp"
+
+#if defined(SILIKANGAROO_X86_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+
+namespace HerdKernel {
+namespace {
+
+// AVX2 has no 64-bit multiply-high, so each 52x52 product is assembled from
+// four 26x26 vpmuludq products.
+struct Avx2 {
+  typedef __m256i T;
+  static constexpr int W = 4;
+
+  static T zero() {
+    return _mm256_setzero_si256();
+  }
+  static T set1(uint64_t x) {
+    return _mm256_set1_epi64x((long long)x);
+  }
+  static T iota(int64_t step) {
+    return _mm256_set_epi64x(3 * step, 2 * step, step, 0);
+  }
+  static T load(const uint64_t* p) {
+    return _mm256_loadu_si256((const __m256i*)p);
+  }
+  static void store(uint64_t* p, T a) {
+    _mm256_storeu_si256((__m256i*)p, a);
+  }
+  static T add(T a, T b) {
+    return _mm256_add_epi64(a, b);
+  }
+  static T sub(T a, T b) {
+    return _mm256_sub_epi64(a, b);
+  }
+  static T andv(T a, T b) {
+    return _mm256_and_si256(a, b);
+  }
+  static T orv(T a, T b) {
+    return _mm256_or_si256(a, b);
+  }
+  template <int S>
+  static T srli(T a) {
+    return _mm256_srli_epi64(a, S);
+  }
+  template <int S>
+  static T slli(T a) {
+    return _mm256_slli_epi64(a, S);
+  }
+  static T mul32(T a, T b) {
+    return _mm256_mul_epu32(a, b);
+  }
+  static T gather(const uint64_t* base, T idx) {
+    return _mm256_i64gather_epi64((const long long*)base, idx, 8);
+  }
+  static void scatter(uint64_t* base, T idx, T a) {
+    uint64_t i[W], v[W];
+    store(i, idx);
+    store(v, a);
+    for (int j = 0; j < W; j++)
+      base[i[j]] = v[j];
+  }
+  static void madd52(T& lo, T& hi, T a, T b) {
+    const T m26 = set1((1ULL << 26) - 1);
+    T a0 = andv(a, m26), a1 = srli<26>(a);
+    T b0 = andv(b, m26), b1 = srli<26>(b);
+
+    T p00 = mul32(a0, b0);
+    T mid = add(mul32(a0, b1), mul32(a1, b0));
+    T p11 = mul32(a1, b1);
+
+    T low = add(p00, slli<26>(andv(mid, m26)));
+    lo = add(lo, andv(low, set1((1ULL << 52) - 1)));
+    hi = add(hi, add(add(p11, srli<26>(mid)), srli<52>(low)));
+  }
+};
+
+}  // namespace
+
+bool stepAvx2(const Args& args) {
+  return stepHerd<Avx2>(args);
+}
+
+}  // namespace HerdKernel
+
+#endif
@@ -0,0 +1,81 @@
+// Built with -mavx512f -mavx512ifma on x86-64 (see CMakeLists.txt)
+#include "HerdStepperKernel.hpp"
+
+#if defined(SILIKANGAROO_X86_SIMD) && defined(__AVX512IFMA__)
+#include <immintrin.h>
+
+// GCC 12 warns about the deliberately undefined pass-through operands used
+// inside its AVX-512 intrinsic wrappers
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace HerdKernel {
+namespace {
+
+// 8 lanes with native 52-bit multiply-accumulate (vpmadd52luq/huq)
+struct Avx512Ifma {
+  typedef __m512i T;
+  static constexpr int W = 8;
+
+  static T zero() {
+    return _mm512_setzero_si512();
+  }
+  static T set1(uint64_t x) {
+    return _mm512_set1_epi64((long long)x);
+  }
+  static T iota(int64_t step) {
+    return _mm512_set_epi64(7 * step, 6 * step, 5 * step, 4 * step, 3 * step,
+                            2 * step, step, 0);
+  }
+  static T load(const uint64_t* p) {
+    return _mm512_loadu_si512((const void*)p);
+  }
+  static void store(uint64_t* p, T a) {
+    _mm512_storeu_si512((void*)p, a);
+  }
+  static T add(T a, T b) {
+    return _mm512_add_epi64(a, b);
+  }
+  static T sub(T a, T b) {
+    return _mm512_sub_epi64(a, b);
+  }
+  static T andv(T a, T b) {
+    return _mm512_and_si512(a, b);
+  }
+  static T orv(T a, T b) {
+    return _mm512_or_si512(a, b);
+  }
+  template <int S>
+  static T srli(T a) {
+    return _mm512_srli_epi64(a, S);
+  }
+  template <int S>
+  static T slli(T a) {
+    return _mm512_slli_epi64(a, S);
+  }
+  static T mul32(T a, T b) {
+    return _mm512_mul_epu32(a, b);
+  }
+  static T gather(const uint64_t* base, T idx) {
+    return _mm512_i64gather_epi64(idx, (const void*)base, 8);
+  }
+  static void scatter(uint64_t* base, T idx, T a) {
+    _mm512_i64scatter_epi64((void*)base, idx, a, 8);
+  }
+  static void madd52(T& lo, T& hi, T a, T b) {
+    lo = _mm512_madd52lo_epu64(lo, a, b);
+    hi = _mm512_madd52hi_epu64(hi, a, b);
+  }
+};
+
+}  // namespace
+
+bool stepAvx512Ifma(const Args& args) {
+  return stepHerd<Avx512Ifma>(args);
+}
+
+}  // namespace HerdKernel
+
+#endif
@@ -0,0 +1,127 @@
+#include "HerdStore.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace {
+
+const size_t kHugePage = 2 << 20;
+
+size_t roundUp(size_t n, size_t to) {
+  return (n + to - 1) / to * to;
+}
+
+}  // namespace
+
+HerdStore::HerdStore(size_t count, int distanceLimbs)
+    : count(count), limbs(distanceLimbs) {
+  if (count == 0)
+    return;
+  size_t pointBytes = roundUp(count * sizeof(AffinePoint), 64);
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  bytes = roundUp(pointBytes + count * sizeof(uint64_t) * limbs, page);
+
+  // Huge pages need an aligned range: map the slack and trim it
+  size_t align = bytes >= kHugePage ? kHugePage : page;
+  size_t mapped = bytes + align - page;
+  void* map = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+    throw std::bad_alloc();
+  uintptr_t start = roundUp((uintptr_t)map, align);
+  size_t head = start - (uintptr_t)map;
+  if (head > 0)
+    munmap(map, head);
+  if (mapped - head > bytes)
+    munmap((char*)start + bytes, mapped - head - bytes);
+  arena = (void*)start;
+
+#ifdef MADV_HUGEPAGE
+  if (align == kHugePage)
+    huge = madvise(arena, bytes, MADV_HUGEPAGE) == 0;
+#endif
+
+  pts = static_cast<AffinePoint*>(arena);
+  dist = reinterpret_cast<uint64_t*>(static_cast<char*>(arena) + pointBytes);
+}
+
+HerdStore::~HerdStore() {
+  release();
+}
+
+HerdStore::HerdStore(HerdStore&& o) noexcept {
+  *this = std::move(o);
+}
+
+HerdStore& HerdStore::operator=(HerdStore&& o) noexcept {
+  if (this != &o) {
+    release();
+    count = std::exchange(o.count, 0);
+    limbs = std::exchange(o.limbs, 0);
+    arena = std::exchange(o.arena, nullptr);
+    bytes = std::exchange(o.bytes, 0);
+    huge = std::exchange(o.huge, false);
+    pts = std::exchange(o.pts, nullptr);
+    dist = std::exchange(o.dist, nullptr);
+  }
+  return *this;
+}
+
+void HerdStore::release() {
+  if (arena)
+    munmap(arena, bytes);
+  arena = nullptr;
+}
+
+void HerdStore::copyFrom(const HerdStore& from, size_t begin, size_t n) {
+  std::memcpy(pts + begin, from.pts + begin, n * sizeof(AffinePoint));
+  std::memcpy(dist + begin * limbs, from.dist + begin * limbs,
+              n * limbs * sizeof(uint64_t));
+}
+
+void HerdStore::exportPoints(size_t begin, size_t n,
+                             unsigned char* out) const {
+  for (size_t i = 0; i < n; i++) {
+    pts[begin + i].x.toBytes(out + 64 * i);
+    pts[begin + i].y.toBytes(out + 64 * i + 32);
+  }
+}
+
+void HerdStore::exportDistances(size_t begin, size_t n,
+                                unsigned char* out) const {
+  std::memset(out, 0, kDistanceBytes * n);
+  for (size_t i = 0; i < n; i++) {
+    const uint64_t* d = dist + (begin + i) * limbs;
+    unsigned char* o = out + kDistanceBytes * (i + 1);
+    for (int l = 0; l < limbs && l < 4; l++) {
+      for (int j = 0; j < 8; j++)
+        *--o = (unsigned char)(d[l] >> (8 * j));
+    }
+  }
+}
+
+void HerdStore::importPoints(size_t begin, size_t n,
+                             const unsigned char* in) {
+  for (size_t i = 0; i < n; i++) {
+    pts[begin + i].x = FieldElement::fromBytes(in + 64 * i);
+    pts[begin + i].y = FieldElement::fromBytes(in + 64 * i + 32);
+  }
+}
+
+void HerdStore::importDistances(size_t begin, size_t n,
+                                const unsigned char* in) {
+  for (size_t i = 0; i < n; i++) {
+    uint64_t* d = dist + (begin + i) * limbs;
+    const unsigned char* p = in + kDistanceBytes * (i + 1);
+    for (int l = 0; l < limbs; l++) {
+      uint64_t limb = 0;
+      for (int j = 0; j < 8 && l < 4; j++)
+        limb |= (uint64_t)*--p << (8 * j);
+      d[l] = limb;
+    }
+  }
+}
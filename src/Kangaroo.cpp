@@ -3,22 +3,33 @@
 #include <omp.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <random>
 #include <thread>
 
+#include "Checkpoint.hpp"
+#include "DPServer.hpp"
+#include "HerdStart.hpp"
+#include "HerdStepper.hpp"
 #include "Utils.hpp"
 
+static uint64_t splitmix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
 Kangaroo::Kangaroo(const mpz_class& startRange, const mpz_class& endRange,
-                   const std::string& targetPubKeyHex, int numThreads)
-    : startRange(startRange),
-      endRange(endRange),
-      targetHex(targetPubKeyHex),
-      numThreads(numThreads) {
+                   const std::vector<std::string>& targetPubKeyHexes,
+                   int numThreads)
+    : startRange(startRange), endRange(endRange), numThreads(numThreads) {
   rangeSize = endRange - startRange;
   if (this->numThreads <= 0) {
     this->numThreads = std::thread::hardware_concurrency();
@@ -26,10 +37,30 @@ Kangaroo::Kangaroo(const mpz_class& startRange, const mpz_class& endRange,
       this->numThreads = 4;
   }
 
-  std::vector<unsigned char> pubBytes = Utils::hexToBytes(targetHex);
-  if (!ecc.parsePublicKey(targetPubKey, pubBytes)) {
-    throw std::runtime_error("Invalid target public key");
+  groupOrder.set_str(
+      "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141", 16);
+
+  uint64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+  seed = splitmix64(now) ^ std::random_device()();
+
+  if (targetPubKeyHexes.empty() ||
+      targetPubKeyHexes.size() > DPTable::kMaxTargets) {
+    throw std::runtime_error("Between 1 and " +
+                             std::to_string(DPTable::kMaxTargets) +
+                             " targets are supported");
   }
+  for (const std::string& hex : targetPubKeyHexes) {
+    secp256k1_pubkey pub;
+    if (!ecc.parsePublicKey(pub, Utils::hexToBytes(hex)))
+      throw std::runtime_error("Invalid target public key: " + hex);
+    targets.push_back(pub);
+    targetKeys.push_back(ecc.serializePublicKey(pub, true));
+  }
+  walkTargets = targets;
+  privateKeys.resize(targets.size());
+  solved.reset(new std::atomic<bool>[targets.size()]);
+  for (size_t i = 0; i < targets.size(); i++)
+    solved[i] = false;
 
   // Calculate dpBits
   mpz_class sqrtN;
@@ -49,42 +80,127 @@ Kangaroo::Kangaroo(const mpz_class& startRange, const mpz_class& endRange,
   std::cout << "Sqrt(N): " << sqrtNd << std::endl;
   std::cout << "DP Bits: " << dpBits << " (1 in " << (1 << dpBits) << ")"
             << std::endl;
-
-  initJumpTable();
 }
 
 Kangaroo::~Kangaroo() {
   shouldStop = true;
+  stopDPPipeline();
+  finishCheckpoint();
 }
 
-void Kangaroo::initJumpTable() {
-  mpz_class sqrtN;
-  mpz_sqrt(sqrtN.get_mpz_t(), rangeSize.get_mpz_t());
+mpz_class Kangaroo::streamSeed(RngStream stream, uint64_t index) const {
+  uint64_t state = seed;
+  state = splitmix64(state) ^ ((uint64_t)stream << 56) ^ index;
+  mpz_class hi((unsigned long)splitmix64(state));
+  mpz_class lo((unsigned long)splitmix64(state));
+  return (hi << 64) + lo;
+}
 
-  int tableSize = 32;  // Power of 2
-  jumpTable.resize(tableSize);
+void Kangaroo::setJumpTableSize(int size) {
+  if (size < 32 || size > 4096 || (size & (size - 1)) != 0)
+    throw std::runtime_error("Jump table size must be a power of 2, 32..4096");
+  jumpTableSize = size;
+}
 
-  gmp_randclass rr(gmp_randinit_default);
-  rr.seed(time(NULL));
+void Kangaroo::initJumpTable(double kangaroos) {
+  walkKangaroos = kangaroos;
+  if (!jumpsFixed && negationMap && !manualDpBits) {
+    // Restarted walks should pay for their scalar multiplication, while
+    // the m walks that run on to their next DP stay cheap
+    double walk = std::sqrt(mpz_get_d(rangeSize.get_mpz_t())) /
+                  (4.0 * std::max(kangaroos, 1.0));
+    int bits = std::min(24, (int)std::log2(std::max(walk, 2.0)));
+    if (bits > dpBits) {
+      dpBits = bits;
+      std::cout << "DP Bits: " << dpBits << " (restarted walks)" << std::endl;
+    }
+  }
+  if (!jumpsFixed)
+    randomJumpTable(kangaroos);
+
+  std::cout << "Jump table: " << jumpTable.size() << " jumps, mean 2^"
+            << std::fixed << std::setprecision(2) << std::log2(jumpMean.load())
+            << " for " << (uint64_t)kangaroos << " kangaroos" << std::endl;
+  std::cout << "Expected jumps: 2^" << std::log2(getExpectedJumps())
+            << std::defaultfloat << std::endl;
+  metrics.setGauge(Metrics::ExpectedJumps, getExpectedJumps());
+}
+
+void Kangaroo::randomJumpTable(double kangaroos) {
+  mpz_class sqrtN;
+  mpz_sqrt(sqrtN.get_mpz_t(), rangeSize.get_mpz_t());
 
+  // Precompute walks restart after every DP: keep the single-walk mean
   mpz_class mean = sqrtN / 2;
+  if (negationMap) {
+    // Walks on {P, -P} wander about u*sqrt(L) in L = 2^dp jumps and soon
+    // cross their own trail unless u >> L^1.5: spread them over an
+    // eighth of the interval instead
+    mean = rangeSize / mpz_class(8.0 * std::sqrt((double)(1ULL << dpBits)));
+  } else if (mode == Mode::Search) {
+    mpz_class m((unsigned long)std::max(kangaroos, 1.0));
+    mean = m * sqrtN / 4;
+    // The herds start closer together: Galbraith-Pollard-Ruprai's 0.375
+    // instead of 0.5 sqrt(N) per pair
+    if (herds > 2)
+      mean = mean * 3 / 4;
+  }
+  // Many kangaroos on a small range: still a few jumps across it
+  if (mean > rangeSize / 8)
+    mean = rangeSize / 8;
   if (mean == 0)
     mean = 1;
 
-  for (int i = 0; i < tableSize; ++i) {
+  gmp_randclass rr(gmp_randinit_default);
+  rr.seed(streamSeed(RngStream::JumpTable));
+
+  // Fruitless 4-cycles of the negation map come about once in n^3/4 jumps:
+  // default to a large table there
+  int size = jumpTableSize > 0 ? jumpTableSize : negationMap ? 2048 : 32;
+  std::vector<mpz_class> dists(size);
+  for (int i = 0; i < size; ++i) {
     mpz_class jumpDist = rr.get_z_range(mean) + mean / 2 + 1;
     if (jumpDist >= rangeSize)
       jumpDist = rangeSize / 2 + 1;
+    // Four herds: even jumps keep each walk on the parity it started on
+    if (herds == 4 && mpz_odd_p(jumpDist.get_mpz_t()))
+      jumpDist += 1;
+    dists[i] = jumpDist;
+  }
+  buildJumpTable(dists);
+}
+
+void Kangaroo::setJumpDistances(const std::vector<mpz_class>& dists) {
+  buildJumpTable(dists);
+  jumpsFixed = true;
+}
 
-    jumpTable[i].dist = jumpDist;
+void Kangaroo::buildJumpTable(const std::vector<mpz_class>& dists) {
+  jumpTable.resize(dists.size());
+  escapeJump.dist = 0;
+  for (size_t i = 0; i < dists.size(); ++i) {
+    jumpTable[i].dist = dists[i];
+    escapeJump.dist += dists[i];
 
     unsigned char scalar[32];
-    Utils::mpzToBytes(jumpDist.get_mpz_t(), scalar);
+    Utils::mpzToBytes(dists[i].get_mpz_t(), scalar);
 
     if (!ecc.getPubKeyFromPriv(jumpTable[i].point, scalar)) {
       throw std::runtime_error("Failed to generate jump point");
     }
+    jumpTable[i].affine = ecc.toAffine(jumpTable[i].point);
   }
+  if (!dists.empty()) {
+    jumpMean =
+        mpz_get_d(escapeJump.dist.get_mpz_t()) / (double)dists.size();
+  }
+
+  unsigned char scalar[32];
+  mpz_class escape = escapeJump.dist % groupOrder;
+  Utils::mpzToBytes(escape.get_mpz_t(), scalar);
+  if (!ecc.getPubKeyFromPriv(escapeJump.point, scalar))
+    throw std::runtime_error("Failed to generate jump point");
+  escapeJump.affine = ecc.toAffine(escapeJump.point);
 }
 
 bool Kangaroo::isDistinguished(const secp256k1_pubkey& point) {
@@ -107,6 +223,11 @@ bool Kangaroo::isDistinguished(const secp256k1_pubkey& point) {
   return true;
 }
 
+bool Kangaroo::isDistinguished(const AffinePoint& point) const {
+  // Same condition as above
+  return ::isDistinguished(point.x, dpBits);
+}
+
 double Kangaroo::getDuration() const {
   auto now = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsed = now - startTime;
@@ -117,7 +238,36 @@ double Kangaroo::getOpsPerSecond() const {
   double duration = getDuration();
   if (duration <= 0)
     return 0;
-  return (double)totalJumps / duration;
+  return (double)getTotalJumps() / duration;
+}
+
+double Kangaroo::getExpectedJumps() const {
+  double n = mpz_get_d(rangeSize.get_mpz_t());
+  double walk = (double)(1ULL << dpBits);
+  // Every walk runs on to its next DP
+  double m = std::max(walkKangaroos.load(), 1.0);
+  if (mode == Mode::Precompute)
+    return (double)tameDbTarget * walk + m * walk;
+  if (mode == Mode::Solve) {
+    // Each wild step lands on a tame path with probability ~T*walk/N
+    return n / ((double)tameDb->size() * walk) + m * walk;
+  }
+
+  if (negationMap)
+    return 1.36 * std::sqrt(n) + m * walk;  // Galbraith-Ruprai
+
+  // m kangaroos with mean jump u: catching up the herd ahead costs about
+  // m*N/(4u) jumps and landing on one of its trails 4u/m. At
+  // u = m*sqrt(N)/4 this is 2*sqrt(N).
+  double u = jumpMean;
+  double expected =
+      u > 0 ? m * n / (4.0 * u) + 4.0 * u / m : 2.0 * std::sqrt(n);
+  // Galbraith-Pollard-Ruprai: 1.818 and 1.714 sqrt(N)
+  if (herds == 3)
+    expected *= 1.818 / 2.0;
+  else if (herds == 4)
+    expected *= 1.714 / 2.0;
+  return expected + m * walk;
 }
 
 double Kangaroo::getEstimatedSecondsRemaining() const {
@@ -125,99 +275,539 @@ double Kangaroo::getEstimatedSecondsRemaining() const {
   if (rate <= 0)
     return -1.0;  // Unknown
 
-  mpz_class sqrtN;
-  mpz_sqrt(sqrtN.get_mpz_t(), rangeSize.get_mpz_t());
-  double expectedTotalOps = mpz_get_d(sqrtN.get_mpz_t()) * 2.0;
-
   // Remaining ops
-  double remainingOps = expectedTotalOps - (double)totalJumps;
+  double remainingOps = getExpectedJumps() - (double)getTotalJumps();
   if (remainingOps < 0)
     remainingOps = 0;
 
   return remainingOps / rate;
 }
 
-void Kangaroo::processCollision(const std::string& pointHex,
-                                const mpz_class& dist, bool isTame) {
-  if (distinguishedPoints.find(pointHex) == distinguishedPoints.end()) {
-    distinguishedPoints[pointHex] = {dist, isTame};
+void Kangaroo::initDPTable(size_t minEntries) {
+  if (dpTable)
+    return;
+
+  // Room for the DPs of a few expected runs
+  mpz_class sqrtN;
+  mpz_sqrt(sqrtN.get_mpz_t(), rangeSize.get_mpz_t());
+  double expectedDPs =
+      2.0 * mpz_get_d(sqrtN.get_mpz_t()) / (double)(1ULL << dpBits);
+  // (within the memory limit, if any: the rest spills to disk)
+  double capacity = std::max(4.0 * expectedDPs, 65536.0);
+  if (dpMemoryLimit == 0)
+    capacity = std::min(capacity, (double)(1ULL << 27));
+  capacity = std::max(capacity, 2.0 * (double)minEntries);
+  dpTable.reset(new DPStore((size_t)capacity, dpMemoryLimit,
+                            checkpointFile + ".runs"));
+  metrics.setGauge(Metrics::DPTableCapacity, (double)dpTable->capacity());
+
+  std::cout << "DP table: " << dpTable->capacity() << " entries ("
+            << dpTable->memoryBytes() / (1024 * 1024) << " MiB)";
+  if (dpTable->spills())
+    std::cout << ", spilling to " << checkpointFile << ".runs";
+  std::cout << std::endl;
+}
+
+void Kangaroo::openJournal() {
+  if (journal || checkpointFile.empty() || mode != Mode::Search)
+    return;
+
+  CheckpointHeader identity;
+  fillCheckpointHeader(identity);
+  try {
+    journal.reset(new DPJournal(checkpointFile + ".journal", identity));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << " (continuing without a journal)" << std::endl;
+  }
+}
+
+void Kangaroo::startDPPipeline(int producers) {
+  dpQueues.clear();
+  for (int i = 0; i < producers; i++)
+    dpQueues.emplace_back(new SpscRing<DPRecord>(4096));
+  deadSlots.assign(producers, std::vector<int>());
+
+  pipelineStop = false;
+  verifyStop = false;
+  ingestThread = std::thread(&Kangaroo::ingestLoop, this);
+  verifyThread = std::thread(&Kangaroo::verifyLoop, this);
+}
+
+void Kangaroo::stopDPPipeline() {
+  // Walkers are done: drain what they pushed, then the candidates
+  pipelineStop = true;
+  if (ingestThread.joinable())
+    ingestThread.join();
+  {
+    std::lock_guard<std::mutex> lock(candidateMutex);
+    verifyStop = true;
+  }
+  candidateCv.notify_one();
+  if (verifyThread.joinable())
+    verifyThread.join();
+}
+
+void Kangaroo::pushDP(int producer, const FieldElement& x,
+                      const DPDistance& dist, uint16_t tag,
+                      uint32_t walker) {
+  DPRecord dp = {DPTable::fingerprint(x), dist, tag, walker};
+  metrics.add(Metrics::DPs);
+  if (!dpQueues[producer]->tryPush(dp)) {
+    uint64_t t = Metrics::nowNs();
+    storeDPs(&dp, 1);  // The table itself is lock-free
+    metrics.add(Metrics::QueueFull);
+    metrics.add(Metrics::QueueWaitNs, Metrics::nowNs() - t);
+  }
+}
+
+void Kangaroo::storeDPs(const DPRecord* dps, size_t count) {
+  if (dpSink) {
+    dpSink->submit(dps, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    processCollision(dps[i]);
+}
+
+void Kangaroo::ingestLoop() {
+  metrics.bindThread();
+  std::vector<DPRecord> batch(1024);
+  for (;;) {
+    // Read the flag first so that a final pass sees every pushed DP
+    bool stopping = pipelineStop;
+    size_t drained = 0;
+
+    // CPU herds checkpoint from here; the batch loop saves its own
+    if (backendName.empty() && !dpSink && mode == Mode::Search &&
+        checkpointRequested && !checkpointWriting) {
+      uint64_t startNs = Metrics::nowNs();
+      beginCheckpoint(checkpointFile, batchHerd);  // Kept from a resume
+      checkpointRequested = false;
+      metrics.add(Metrics::CheckpointStallNs, Metrics::nowNs() - startNs);
+    }
+
+    for (auto& q : dpQueues) {
+      size_t n = q->popBatch(batch.data(), batch.size());
+      storeDPs(batch.data(), n);
+      drained += n;
+    }
+    if (dpSink)
+      dpSink->reportJumps(getTotalJumps());
+    if (dpTable) {
+      metrics.setGauge(Metrics::DPTableEntries, (double)dpTable->size());
+      metrics.setGauge(Metrics::DPSpilledEntries, (double)dpTable->spilled());
+      metrics.setGauge(Metrics::DPRuns, (double)dpTable->runCount());
+    }
+    if (drained == 0) {
+      if (stopping)
+        return;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+}
+
+void Kangaroo::verifyLoop() {
+  std::unique_lock<std::mutex> lock(candidateMutex);
+  for (;;) {
+    candidateCv.wait(lock, [&] { return verifyStop || !candidates.empty(); });
+    if (candidates.empty())
+      return;  // verifyStop with nothing left
+    std::pair<DPRecord, DPRecord> c = candidates.front();
+    candidates.pop_front();
+
+    lock.unlock();
+    verifyCollision(c.first, c.second);
+    lock.lock();
+  }
+}
+
+void Kangaroo::processCollision(const DPRecord& dp) {
+  DPTable::Match other;
+  if (tameDb && !(dp.tag & DPTable::kTagTame) &&
+      tameDb->find(dp.fp, other.dist)) {
+    queueCandidate({dp.fp, other.dist, DPTable::kTagTame}, dp);
+  }
+
+  uint64_t probes = 0;
+  DPTable::InsertResult result =
+      dpTable->insert(dp.fp, dp.dist, dp.tag, &other, &probes);
+  metrics.add(Metrics::TableProbes, probes);
+  switch (result) {
+    case DPTable::InsertResult::Inserted:
+      metrics.add(Metrics::TableInserts);
+      if (journal)
+        journal->append(Checkpoint::pack(dp.fp, dp.dist, dp.tag));
+      return;
+    case DPTable::InsertResult::Full:
+      if (!dpTableFull.exchange(true)) {
+        if (dpTable->spills()) {
+          std::cerr << "Warning: DP runs cannot be written, new DPs are "
+                       "dropped"
+                    << std::endl;
+        } else {
+          std::cerr << "Warning: DP table full (" << dpTable->size()
+                    << " DPs), new DPs are dropped; --dp-memory-limit "
+                       "spills them to disk instead"
+                    << std::endl;
+        }
+      }
+      if (mode == Mode::Precompute)
+        shouldStop = true;
+      return;
+    case DPTable::InsertResult::Matched:
+      break;
+  }
+
+  bool isTame = (dp.tag & DPTable::kTagTame) != 0;
+  bool otherTame = (other.tag & DPTable::kTagTame) != 0;
+  DPRecord theirs = {dp.fp, other.dist, other.tag};
+  if (other.tag == dp.tag) {
+    // Same kind: the newcomer only retraces the other's walk from here
+    metrics.add(isTame ? Metrics::TameCollisions : Metrics::WildCollisions);
+    markDead(dp.walker);
+    return;
+  }
+  if (isTame && otherTame) {
+    // The two tame herds walk on opposite parities: a fingerprint clash
+    metrics.add(Metrics::TameCollisions);
     return;
   }
+  if (!isTame && !otherTame)
+    metrics.add(Metrics::WildCollisions);
+
+  // Collision between Tame and Wild! Verified on the verification thread
+  if (isTame) {
+    queueCandidate(dp, theirs);
+  } else if (otherTame) {
+    queueCandidate(theirs, dp);
+  } else if (DPTable::targetIndex(other.tag) ==
+             DPTable::targetIndex(dp.tag)) {
+    // The key's two wild herds (from +-key) met
+    queueCandidate(theirs, dp);
+  } else {
+    // Two targets' wilds met: the key of one gives the other
+    if (solved[DPTable::targetIndex(other.tag)])
+      queueCandidate(theirs, dp);
+    else if (solved[DPTable::targetIndex(dp.tag)])
+      queueCandidate(dp, theirs);
+  }
+}
 
-  DistinguishedPoint& other = distinguishedPoints[pointHex];
-  if (other.isTame == isTame) {
+void Kangaroo::markDead(uint32_t walker) {
+  // Other walks restart at every DP anyway
+  if (walker == DPRecord::kNoWalker || mode != Mode::Search || negationMap)
     return;
+  size_t producer = walker / walkersPerProducer;
+  std::lock_guard<std::mutex> lock(deadMutex);
+  if (producer >= deadSlots.size())
+    return;
+  deadSlots[producer].push_back(walker % walkersPerProducer);
+  deadQueued++;
+}
+
+void Kangaroo::takeDead(int producer, std::vector<int>& slots) {
+  slots.clear();
+  {
+    std::lock_guard<std::mutex> lock(deadMutex);
+    slots.swap(deadSlots[producer]);
+  }
+  // A walker may find another DP on the trail before it is respawned
+  std::sort(slots.begin(), slots.end());
+  slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+}
+
+void Kangaroo::queueCandidate(const DPRecord& known, const DPRecord& wild) {
+  metrics.add(Metrics::Candidates);
+  {
+    uint64_t t = Metrics::nowNs();
+    std::lock_guard<std::mutex> lock(candidateMutex);
+    metrics.add(Metrics::LockWaitNs, Metrics::nowNs() - t);
+    candidates.emplace_back(known, wild);
   }
+  candidateCv.notify_one();
+}
+
+void Kangaroo::verifyCollision(const DPRecord& known, const DPRecord& wild) {
+  uint32_t target = DPTable::targetIndex(wild.tag);
+  if (target >= targets.size() || solved[target])
+    return;
 
-  // Collision between Tame and Wild!
-  mpz_class distTame = isTame ? dist : other.distance;
-  mpz_class distWild = isTame ? other.distance : dist;
+  bool knownTame = (known.tag & DPTable::kTagTame) != 0;
+  mpz_class solvedKey;
+  if (!knownTame) {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    solvedKey = privateKeys[DPTable::targetIndex(known.tag)];
+  }
 
-  mpz_class candidate = distTame - distWild;
+  std::vector<mpz_class> keys;
+  if (herds > 2) {
+    // Each DP is at a * (key - center) + d, where a is 0 for tames, 1 for
+    // the first wild herd and -1 for the second
+    auto sign = [](uint16_t tag) {
+      if (tag & DPTable::kTagTame)
+        return 0;
+      return (tag & DPTable::kTagSecondHerd) ? -1 : 1;
+    };
+    int aw = sign(wild.tag);
+    int ak = sign(known.tag);
+    mpz_class w = wild.dist.toSignedMpz(DPTable::kDistanceBits);
+    mpz_class d = known.dist.toSignedMpz(DPTable::kDistanceBits);
+    if (ak != 0 && DPTable::targetIndex(known.tag) != target) {
+      // Another target's wild, whose key is known
+      d += ak * (solvedKey - center);
+      ak = 0;
+    }
+    if (aw == ak)
+      return;
+    // The fingerprint is of x, so the two points are equal or opposite:
+    // (aw - ak) * (key - center) == d - w, or
+    // (aw + ak) * (key - center) == -(d + w). Factors are +-1 or +-2:
+    // halve mod N (odd) when the two wild herds met.
+    auto solve = [&](int a, mpz_class rhs) {
+      if (a == 0)
+        return;
+      if (mpz_odd_p(rhs.get_mpz_t()))
+        rhs += groupOrder;
+      keys.push_back(center + rhs / a);
+    };
+    solve(aw - ak, d - w);
+    solve(aw + ak, -(d + w));
+  } else if (!negationMap) {
+    // Both DPs are the same point: base + known.dist == key + wild.dist
+    mpz_class base = knownTame ? startRange : solvedKey;
+    keys.push_back(base + known.dist.toMpz() - wild.dist.toMpz());
+  } else {
+    // Each DP stands for +-P and its distance is signed:
+    // +-s == +-(key - center) + w, where s is the known DP's scalar
+    mpz_class w = wild.dist.toSignedMpz(DPTable::kDistanceBits);
+    mpz_class d = known.dist.toSignedMpz(DPTable::kDistanceBits);
+    std::vector<mpz_class> scalars;
+    if (knownTame) {
+      scalars.push_back(d);
+    } else {
+      scalars.push_back(solvedKey - center + d);
+      scalars.push_back(center - solvedKey + d);
+    }
+    for (const mpz_class& sc : scalars) {
+      keys.push_back(center + sc - w);
+      keys.push_back(center - sc - w);
+      keys.push_back(center + w - sc);
+      keys.push_back(center + sc + w);
+    }
+  }
 
-  mpz_class N;
-  N.set_str("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141",
-            16);
-  candidate = candidate % N;
-  if (candidate < 0)
-    candidate += N;
+  for (mpz_class& candidate : keys) {
+    // The fingerprint may be shared by an unrelated point: check the key
+    candidate = candidate % groupOrder;
+    if (candidate < 0)
+      candidate += groupOrder;
 
-  secp256k1_pubkey checkPub;
-  unsigned char privBytes[32];
+    secp256k1_pubkey checkPub;
+    unsigned char privBytes[32];
 
-  Utils::mpzToBytes(candidate.get_mpz_t(), privBytes);
-  if (ecc.getPubKeyFromPriv(checkPub, privBytes)) {
+    Utils::mpzToBytes(candidate.get_mpz_t(), privBytes);
+    if (!ecc.getPubKeyFromPriv(checkPub, privBytes))
+      continue;
     std::vector<unsigned char> checkHex =
         ecc.serializePublicKey(checkPub, true);
-    std::vector<unsigned char> targetSer =
-        ecc.serializePublicKey(targetPubKey, true);
 
-    if (checkHex == targetSer) {
-      found = true;
-      privateKey = candidate;
-      shouldStop = true;
+    if (checkHex == targetKeys[target]) {
+      std::lock_guard<std::mutex> lock(resultMutex);
+      privateKeys[target] = candidate;
+      solved[target] = true;
+      if (targets.size() > 1) {
+        std::cout << "\nSolved target " << target << ": "
+                  << candidate.get_str(16) << std::endl;
+      }
+      if (++solvedCount == targets.size()) {
+        found = true;
+        shouldStop = true;
+      }
+      return;
     }
   }
+  // A real match always gives the key: this is a fingerprint clash, or
+  // distances that do not add up
+  metrics.add(Metrics::FalseCandidates);
+}
+
+uint32_t Kangaroo::nextUnsolvedTarget(uint32_t target) const {
+  for (size_t i = 1; i <= targets.size(); i++) {
+    uint32_t t = (target + i) % targets.size();
+    if (!solved[t])
+      return t;
+  }
+  return target;
+}
+
+void Kangaroo::fillCheckpointHeader(CheckpointHeader& header) {
+  std::memset(&header, 0, sizeof(header));
+  Utils::mpzToBytes(startRange.get_mpz_t(), header.startRange);
+  Utils::mpzToBytes(endRange.get_mpz_t(), header.endRange);
+  // Multi-target runs are identified by their first target
+  std::memcpy(header.target, targetKeys[0].data(), sizeof(header.target));
+  header.flags = negationMap ? kCheckpointSymmetric
+                : herds == 3  ? kCheckpointThreeHerds
+                : herds == 4  ? kCheckpointFourHerds
+                              : 0;
+  header.dpBits = dpBits;
 }
 
 void Kangaroo::saveCheckpoint(const std::string& file) {
-  std::lock_guard<std::mutex> lock(mapMutex);
-  std::ofstream out(file);
-  if (!out.is_open()) {
-    std::cerr << "Failed to open checkpoint file for writing: " << file
-              << std::endl;
+  finishCheckpoint();
+  initDPTable();
+
+  CheckpointHeader header;
+  fillCheckpointHeader(header);
+  header.totalJumps = getTotalJumps();
+  header.duration = getDuration();
+  writeCheckpoint(file, header, batchHerd);
+}
+
+void Kangaroo::beginCheckpoint(const std::string& file,
+                               const HerdStore& herd) {
+  finishCheckpoint();
+  CheckpointHeader header;
+  fillCheckpointHeader(header);
+  header.totalJumps = getTotalJumps();
+  header.duration = getDuration();
+
+  checkpointWriting = true;
+  checkpointWriter = std::thread([this, file, header, &herd] {
+    writeCheckpoint(file, header, herd);
+    checkpointWriting = false;
+  });
+}
+
+void Kangaroo::finishCheckpoint() {
+  if (checkpointWriter.joinable())
+    checkpointWriter.join();
+}
+
+void Kangaroo::writeCheckpoint(const std::string& file,
+                               const CheckpointHeader& header,
+                               const HerdStore& herd) {
+  uint64_t startNs = Metrics::nowNs();
+
+  // DPs stored from here on are journaled past this checkpoint
+  bool journaled = journal && file == checkpointFile;
+  if (journaled)
+    journal->rotate();
+
+  try {
+    CheckpointWriter writer(file, header);
+
+    std::vector<unsigned char> jumps(32 * jumpTable.size());
+    for (size_t i = 0; i < jumpTable.size(); i++)
+      Utils::mpzToBytes(jumpTable[i].dist.get_mpz_t(), &jumps[32 * i]);
+    writer.writeJumps(jumps.data(), jumpTable.size());
+
+    dpTable->forEach([&](uint64_t fp, const DPDistance& d, uint16_t tag) {
+      writer.writeRecord(Checkpoint::pack(fp, d, tag));
+    });
+
+    // The herd in its big-endian exchange format, a chunk at a time
+    const size_t chunk = 4096;
+    std::vector<unsigned char> buf(chunk * 64);
+    for (size_t i = 0; i < herd.size(); i += chunk) {
+      size_t n = std::min(chunk, herd.size() - i);
+      herd.exportPoints(i, n, buf.data());
+      writer.writeGpuPoints(buf.data(), n * 64);
+    }
+    for (size_t i = 0; i < herd.size(); i += chunk) {
+      size_t n = std::min(chunk, herd.size() - i);
+      herd.exportDistances(i, n, buf.data());
+      writer.writeGpuDists(buf.data(), n * HerdStore::kDistanceBytes);
+    }
+    writer.finish();
+    if (journaled)
+      journal->commit();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
     return;
   }
 
-  out << "V1" << std::endl;
-  out << "TOTAL_JUMPS " << totalJumps << std::endl;
-  out << "DURATION " << getDuration() << std::endl;
-  out << "DP_BITS " << dpBits << std::endl;
+  metrics.add(Metrics::Checkpoints);
+  metrics.add(Metrics::CheckpointNs, Metrics::nowNs() - startNs);
+  std::cout << "Checkpoint saved to " << file << std::endl;
+}
 
-  out << "DISTINGUISHED_POINTS " << distinguishedPoints.size() << std::endl;
-  for (const auto& kv : distinguishedPoints) {
-    // hex dist isTame
-    out << kv.first << " " << kv.second.distance.get_str(16) << " "
-        << kv.second.isTame << std::endl;
+void Kangaroo::loadCheckpoint(const std::string& file) {
+  size_t journalDPs = DPJournal::pendingRecords(file + ".journal");
+  if (Checkpoint::isBinary(file))
+    loadCheckpointV2(file, journalDPs);
+  else
+    loadCheckpointV1(file, journalDPs);
+
+  // DPs found after that checkpoint was written
+  initDPTable(journalDPs);
+  CheckpointHeader identity;
+  fillCheckpointHeader(identity);
+  size_t replayed = DPJournal::replay(
+      file + ".journal", identity, [&](const CheckpointRecord& r) {
+        dpTable->insert(r.fp, Checkpoint::distance(r), Checkpoint::tag(r),
+                        nullptr);
+      });
+  if (replayed > 0) {
+    std::cout << "Replayed " << replayed << " DPs from " << file
+              << ".journal" << std::endl;
+    loadedFromCheckpoint = true;
   }
+}
 
-  if (!savedGpuPoints.empty()) {
-    out << "GPU_POINTS " << savedGpuPoints.size() << std::endl;
-    out << Utils::bytesToHex(savedGpuPoints) << std::endl;
-    out << "GPU_DISTS " << savedGpuDists.size() << std::endl;
-    out << Utils::bytesToHex(savedGpuDists) << std::endl;
-  } else {
-    out << "GPU_POINTS 0" << std::endl;
-    out << "GPU_DISTS 0" << std::endl;
+void Kangaroo::loadCheckpointV2(const std::string& file, size_t extraDPs) {
+  CheckpointReader reader(file);
+  const CheckpointHeader& h = reader.header();
+
+  CheckpointHeader expected;
+  fillCheckpointHeader(expected);
+  if (std::memcmp(h.startRange, expected.startRange, 32) != 0 ||
+      std::memcmp(h.endRange, expected.endRange, 32) != 0 ||
+      std::memcmp(h.target, expected.target, 33) != 0) {
+    throw std::runtime_error("Checkpoint is for a different range or target");
+  }
+  if (h.flags != expected.flags)
+    throw std::runtime_error("Checkpoint is for another mode or herd count");
+
+  loadedJumps = h.totalJumps;
+  loadedDuration = h.duration;
+  if (!manualDpBits)
+    dpBits = h.dpBits;
+
+  // Resume the same walks: they only merge under the same jump table
+  if (h.jumpCount > 0) {
+    std::vector<mpz_class> dists(h.jumpCount);
+    for (uint32_t i = 0; i < h.jumpCount; i++)
+      Utils::bytesToMpz(dists[i].get_mpz_t(), reader.jumps() + 32 * i);
+    setJumpDistances(dists);
   }
 
-  std::cout << "Checkpoint saved to " << file << std::endl;
+  initDPTable(h.dpCount + extraDPs);
+  const CheckpointRecord* records = reader.records();
+  int64_t count = (int64_t)h.dpCount;
+  omp_set_num_threads(numThreads);
+#pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < count; i++) {
+    dpTable->insert(records[i].fp, Checkpoint::distance(records[i]),
+                    Checkpoint::tag(records[i]), nullptr);
+  }
+
+  loadBatchHerd(reader.gpuPoints(), h.gpuPointBytes, reader.gpuDists(),
+                h.gpuDistBytes);
+
+  std::cout << "Loaded " << h.dpCount << " DPs and " << h.jumpCount
+            << " jumps from " << file << std::endl;
+  loadedFromCheckpoint = true;
 }
 
-void Kangaroo::loadCheckpoint(const std::string& file) {
+void Kangaroo::loadCheckpointV1(const std::string& file, size_t extraDPs) {
   std::ifstream in(file);
   if (!in.is_open())
     return;
+  if (negationMap)
+    throw std::runtime_error("Text checkpoints have no symmetric mode");
+  if (herds > 2)
+    throw std::runtime_error("Text checkpoints hold two herds only");
 
   std::string line;
   std::string version;
@@ -227,12 +817,13 @@ void Kangaroo::loadCheckpoint(const std::string& file) {
     return;
   }
 
+  std::vector<unsigned char> gpuPoints, gpuDists;
   std::string label;
   while (in >> label) {
     if (label == "TOTAL_JUMPS") {
       uint64_t j;
       in >> j;
-      totalJumps = j;
+      loadedJumps = j;
     } else if (label == "DURATION") {
       in >> loadedDuration;
     } else if (label == "DP_BITS") {
@@ -243,13 +834,27 @@ void Kangaroo::loadCheckpoint(const std::string& file) {
     } else if (label == "DISTINGUISHED_POINTS") {
       size_t count;
       in >> count;
+      initDPTable(count + extraDPs);
       for (size_t i = 0; i < count; ++i) {
-        std::string hex, distHex;
+        std::string key, distHex;
         bool isTame;
-        in >> hex >> distHex >> isTame;
+        in >> key >> distHex >> isTame;
+
+        // Older checkpoints are keyed on the compressed point
+        uint64_t fp;
+        if (key.size() == 66) {
+          std::vector<unsigned char> ser = Utils::hexToBytes(key);
+          fp = DPTable::fingerprint(FieldElement::fromBytes(ser.data() + 1));
+        } else {
+          fp = std::stoull(key, nullptr, 16);
+        }
+
         mpz_class dist;
         dist.set_str(distHex, 16);
-        distinguishedPoints[hex] = {dist, isTame};
+        if (isTame)
+          dist -= startRange;
+        dpTable->insert(fp, DPDistance::fromMpz(dist),
+                        isTame ? DPTable::kTagTame : 0, nullptr);
       }
     } else if (label == "GPU_POINTS") {
       size_t count;
@@ -257,7 +862,7 @@ void Kangaroo::loadCheckpoint(const std::string& file) {
       if (count > 0) {
         std::string hex;
         in >> hex;
-        savedGpuPoints = Utils::hexToBytes(hex);
+        gpuPoints = Utils::hexToBytes(hex);
       }
     } else if (label == "GPU_DISTS") {
       size_t count;
@@ -265,34 +870,260 @@ void Kangaroo::loadCheckpoint(const std::string& file) {
       if (count > 0) {
         std::string hex;
         in >> hex;
-        savedGpuDists = Utils::hexToBytes(hex);
+        gpuDists = Utils::hexToBytes(hex);
       }
     }
   }
+  loadBatchHerd(gpuPoints.data(), gpuPoints.size(), gpuDists.data(),
+                gpuDists.size());
   loadedFromCheckpoint = true;
 }
 
+void Kangaroo::loadBatchHerd(const unsigned char* points, size_t pointBytes,
+                             const unsigned char* dists, size_t distBytes) {
+  size_t count =
+      std::min(pointBytes / 64, distBytes / HerdStore::kDistanceBytes);
+  batchHerd = HerdStore(count, 4);
+  batchHerd.importPoints(0, count, points);
+  batchHerd.importDistances(0, count, dists);
+}
+
 void Kangaroo::requestCheckpoint(const std::string& file) {
   std::lock_guard<std::mutex> lock(checkpointMutex);
   checkpointFile = file;
   checkpointRequested = true;
 }
 
+void Kangaroo::setNegationMap(bool enable) {
+  negationMap = enable;
+  centerTargets();
+}
+
+void Kangaroo::setBackend(const std::string& name) {
+  std::vector<std::string> names = ComputeBackend::available();
+  if (!name.empty() &&
+      std::find(names.begin(), names.end(), name) == names.end())
+    throw std::runtime_error("This build has no '" + name + "' backend");
+  backendName = name;
+}
+
+void Kangaroo::setHerds(int count) {
+  if (count < 2 || count > 4)
+    throw std::runtime_error("Herds must be 2, 3 or 4");
+  herds = count;
+  centerTargets();
+}
+
+void Kangaroo::centerTargets() {
+  walkTargets = targets;
+  negatedWalkTargets.clear();
+  if (!centered())
+    return;
+
+  // Centre the interval on zero: key - center lies in [-W/2, W/2], and so
+  // does its negation
+  center = (startRange + endRange) / 2;
+  mpz_class shift = (groupOrder - center % groupOrder) % groupOrder;
+  unsigned char scalar[32];
+  Utils::mpzToBytes(shift.get_mpz_t(), scalar);
+  for (secp256k1_pubkey& walkTarget : walkTargets)
+    ecc.addScalar(walkTarget, scalar);
+
+  for (const secp256k1_pubkey& walkTarget : walkTargets) {
+    if (herds == 2)
+      break;
+    AffinePoint p = ecc.toAffine(walkTarget);
+    Field::neg(p.y, p.y);
+    secp256k1_pubkey negated;
+    if (!ecc.fromAffine(negated, p))
+      throw std::runtime_error("Failed to negate a target");
+    negatedWalkTargets.push_back(negated);
+  }
+}
+
+Kangaroo::Herd Kangaroo::herdOf(int slot) const {
+  static const Herd four[4] = {Herd::Tame, Herd::Wild, Herd::SecondTame,
+                               Herd::SecondWild};
+  static const Herd three[3] = {Herd::Tame, Herd::Wild, Herd::SecondWild};
+  return herds == 3 ? three[slot % 3] : four[slot % herds];
+}
+
+uint16_t Kangaroo::herdTag(Herd herd, uint32_t target) {
+  switch (herd) {
+    case Herd::Tame:
+      return DPTable::kTagTame;
+    case Herd::SecondTame:
+      return DPTable::kTagTame | DPTable::kTagSecondHerd;
+    case Herd::Wild:
+      return DPTable::wildTag(target);
+    case Herd::SecondWild:
+      break;
+  }
+  return DPTable::wildTag(target) | DPTable::kTagSecondHerd;
+}
+
+void Kangaroo::setPrecompute(const std::string& file, size_t tameDPs) {
+  mode = Mode::Precompute;
+  tameDbFile = file;
+  tameDbTarget = tameDPs;
+
+  // Walks of about sqrt(N/T)/2 steps: long enough for each to cover new
+  // ground, short enough that T of them stay cheap
+  if (!manualDpBits) {
+    double walk =
+        std::sqrt(mpz_get_d(rangeSize.get_mpz_t()) / (double)tameDPs) / 2.0;
+    dpBits = std::max(1, std::min(24, (int)std::log2(std::max(walk, 2.0))));
+    std::cout << "DP Bits: " << dpBits << " (precompute)" << std::endl;
+  }
+}
+
+void Kangaroo::setTameDatabase(const std::string& file) {
+  tameDb.reset(new TameDatabase(file));
+  const CheckpointHeader& h = tameDb->header();
+
+  mpz_class dbStart, dbEnd;
+  Utils::bytesToMpz(dbStart.get_mpz_t(), h.startRange);
+  Utils::bytesToMpz(dbEnd.get_mpz_t(), h.endRange);
+  if (dbEnd - dbStart != rangeSize) {
+    throw std::runtime_error("Tame database is for an interval of width " +
+                             mpz_class(dbEnd - dbStart).get_str(16));
+  }
+
+  // Walks only meet the database's under its jumps and DP condition
+  std::vector<mpz_class> dists(h.jumpCount);
+  for (uint32_t i = 0; i < h.jumpCount; i++)
+    Utils::bytesToMpz(dists[i].get_mpz_t(), tameDb->jumps() + 32 * i);
+  setJumpDistances(dists);
+  if (manualDpBits && dpBits != h.dpBits) {
+    std::cerr << "Warning: using the tame database's " << h.dpBits
+              << " DP bits" << std::endl;
+  }
+  dpBits = h.dpBits;
+
+  // Move the targets into the database's interval: a key there is
+  // key - startRange + dbStart, and a match still gives
+  // key = startRange + distTame - distWild
+  mpz_class shift = (dbStart - startRange) % groupOrder;
+  if (shift < 0)
+    shift += groupOrder;
+  walkTargets = targets;
+  if (shift != 0) {
+    unsigned char scalar[32];
+    Utils::mpzToBytes(shift.get_mpz_t(), scalar);
+    for (secp256k1_pubkey& walkTarget : walkTargets)
+      ecc.addScalar(walkTarget, scalar);
+  }
+
+  mode = Mode::Solve;
+  tameDbFile = file;
+  std::cout << "Tame database: " << tameDb->size() << " DPs, " << dpBits
+            << " DP bits, " << h.jumpCount << " jumps" << std::endl;
+}
+
+void Kangaroo::writeTameDatabase() {
+  CheckpointHeader header;
+  fillCheckpointHeader(header);
+  header.totalJumps = getTotalJumps();
+  header.duration = getDuration();
+
+  std::vector<unsigned char> jumps(32 * jumpTable.size());
+  for (size_t i = 0; i < jumpTable.size(); i++)
+    Utils::mpzToBytes(jumpTable[i].dist.get_mpz_t(), &jumps[32 * i]);
+
+  std::vector<CheckpointRecord> records;
+  records.reserve(dpTable->size());
+  dpTable->forEach([&](uint64_t fp, const DPDistance& d, uint16_t tag) {
+    if (tag & DPTable::kTagTame)
+      records.push_back(Checkpoint::pack(fp, d, tag));
+  });
+
+  TameDatabase::write(tameDbFile, header, jumps, records);
+  std::cout << "\nWrote " << records.size() << " tame DPs to " << tameDbFile
+            << std::endl;
+}
+
+void Kangaroo::runServer() {
+  if (targets.size() > 1)
+    throw std::runtime_error("The DP server takes a single target");
+
+  // The fleet's size is unknown here: size the mean for one local run
+  initJumpTable((double)numThreads * cpuHerdSize);
+  initDPTable();
+  openJournal();
+  startDPPipeline(0);  // Verification and checkpoints only
+
+  CheckpointHeader config;
+  fillCheckpointHeader(config);
+  std::memcpy(config.magic, kCheckpointMagic, sizeof(config.magic));
+  config.version = kCheckpointVersion;
+  config.headerSize = sizeof(config);
+  config.jumpCount = jumpTable.size();
+  std::vector<unsigned char> jumps(32 * jumpTable.size());
+  for (size_t i = 0; i < jumpTable.size(); i++)
+    Utils::mpzToBytes(jumpTable[i].dist.get_mpz_t(), &jumps[32 * i]);
+
+  DPServer server(
+      serverPort, config, jumps,
+      [this](const DPRecord& dp) {
+        metrics.add(Metrics::DPs);
+        processCollision(dp);
+      },
+      [this](uint64_t jumps) { metrics.add(Metrics::Jumps, jumps); });
+  server.start();
+  std::cout << "DP server listening on port " << serverPort << std::endl;
+
+  auto lastStats = std::chrono::steady_clock::now();
+  while (!shouldStop) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastStats >= std::chrono::seconds(10)) {
+      std::cout << "\nWorkers:" << std::endl;
+      server.printStats(std::cout);
+      lastStats = now;
+    }
+  }
+
+  unsigned char key[32];
+  if (found) {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    Utils::mpzToBytes(privateKeys[0].get_mpz_t(), key);
+  }
+  server.stop(found, key);
+  stopDPPipeline();
+}
+
 void Kangaroo::run() {
   startTime = std::chrono::high_resolution_clock::now();
+  std::cout << "Seed: " << seed << std::endl;
+  if (herds > 2 && (negationMap || mode != Mode::Search))
+    throw std::runtime_error("Three and four herds need a plain search");
+
+  if (serverPort > 0) {
+    runServer();
+    return;
+  }
+
+  if (negationMap) {
+    std::cout << "Negation map: symmetric interval around "
+              << center.get_str(16) << std::endl;
+  } else if (herds > 2) {
+    std::cout << "Herds: " << herds << " (Galbraith-Pollard-Ruprai) around "
+              << center.get_str(16) << std::endl;
+  }
 
-  int tameCount = numThreads / 2;
-  if (tameCount < 1)
-    tameCount = 1;
-  int wildCount = numThreads - tameCount;
+  if (!backendName.empty() && mode != Mode::Search) {
+    std::cout << "Precompute and solve modes run on the CPU herds."
+              << std::endl;
+    backendName.clear();
+  }
 
-  std::cout << "Starting " << tameCount << " Tame and " << wildCount
-            << " Wild kangaroos." << std::endl;
+  // Batch backend (Metal GPU, or the CPU one)
+  if (!backendName.empty()) {
+    backend = ComputeBackend::create(backendName, numThreads);
+    uint32_t maxFound = backend->maxFoundDPs();
 
-  // Metal GPU Check
-  if (useGPU) {
     // Dynamic Tuning for GPU
-    if (!manualDpBits) {
+    if (!manualDpBits && maxFound > 0) {
       mpz_class sqrtN;
       mpz_sqrt(sqrtN.get_mpz_t(), rangeSize.get_mpz_t());
       double expectedOps = mpz_get_d(sqrtN.get_mpz_t()) * 2.0;
@@ -307,10 +1138,10 @@ void Kangaroo::run() {
       }
     }
 
-    if (!manualGpuParams) {
+    if (!manualGpuParams && maxFound > 0) {
       // 2. Safety Check: Ensure (batchSize * steps * probability) < bufferSize
       double prob = 1.0 / (double)(1ULL << dpBits);
-      double maxTotalSteps = 2048.0 / prob;
+      double maxTotalSteps = maxFound / 2.0 / prob;
 
       // If dpBits is small (small range), maxTotalSteps will be small.
       if ((double)gpuBatchSize * stepsPerLaunch > maxTotalSteps) {
@@ -326,207 +1157,555 @@ void Kangaroo::run() {
       }
     }
 
-    std::cout << "GPU Parameters:" << std::endl;
+    std::cout << "Batch Parameters:" << std::endl;
     std::cout << "  Batch Size: " << gpuBatchSize << std::endl;
     std::cout << "  Steps: " << stepsPerLaunch << std::endl;
     std::cout << "  DP Bits: " << dpBits << std::endl;
 
-    std::cout << "Initializing Metal Accelerator..." << std::endl;
-    metalAccel.init(jumpTable);
+    initJumpTable(gpuBatchSize);
+    std::cout << "Initializing " << backend->name() << " backend..."
+              << std::endl;
+    backend->init(jumpTable, escapeJump);
+
+    // Batch solver loop. The herd stays in batchHerd between launches and
+    // in checkpoints ("GPU state").
 
-    // GPU Solver Loop
-    std::vector<unsigned char> gpuPoints;
-    std::vector<unsigned char> gpuDists;
+    // Slots cycle through the herds (herdOf); wild ones walk for target
+    // gpuTargets[i]
+    std::vector<uint32_t> gpuTargets(gpuBatchSize);
+    for (int i = 0; i < gpuBatchSize; i++)
+      gpuTargets[i] = (i / herds) % targets.size();
 
-    if (loadedFromCheckpoint && !savedGpuPoints.empty() &&
-        !savedGpuDists.empty()) {
+    // Negation map: jumps of each slot since its last restart
+    std::vector<uint64_t> gpuWalkLength(gpuBatchSize, 0);
+
+    gmp_randclass rr(gmp_randinit_default);
+    rr.seed(streamSeed(RngStream::GpuHerd));
+
+    // Batch distances are absolute, as scalars mod N
+    auto slotStart = [&](int i) {
+      HerdStart start;
+      Herd herd = herdOf(i);
+      if (herds > 2) {
+        // Tames from the centre, wilds from +-(key - center); same
+        // parities as on the CPU
+        start.spread = rangeSize / 100 + 1;
+        start.even = herds == 4;
+        if (herd == Herd::SecondTame)
+          start.base = 1;
+        if (!isTameHerd(herd)) {
+          const std::vector<secp256k1_pubkey>& from =
+              herd == Herd::Wild ? walkTargets : negatedWalkTargets;
+          start.anchor = &from[gpuTargets[i]];
+        }
+      } else if (isTameHerd(herd)) {
+        // Symmetric tames hold their key - center
+        start.base = negationMap ? mpz_class(-(rangeSize / 2)) : endRange;
+        start.spread = rangeSize;
+      } else {
+        // Symmetric wilds start within W/4 of the target
+        start.anchor = &walkTargets[gpuTargets[i]];
+        start.base = negationMap ? mpz_class(-(rangeSize / 4)) : 0;
+        start.spread = negationMap ? mpz_class(rangeSize / 2) : rangeSize;
+      }
+      return start;
+    };
+    auto placeGpuSlot = [&](int i, const HerdStart& start,
+                            const AffinePoint& point,
+                            const Distance<4>& offset) {
+      gpuWalkLength[i] = 0;
+      mpz_class d = (start.base + offset.toMpz()) % groupOrder;
+      if (d < 0)
+        d += groupOrder;
+      unsigned char scalar[32];
+      Utils::mpzToBytes(d.get_mpz_t(), scalar);
+      batchHerd.importDistances(i, 1, scalar);
+      batchHerd.points()[i] = point;
+    };
+    auto initGpuSlot = [&](int i) {
+      HerdStart start = slotStart(i);
+      Distance<4> offset;
+      AffinePoint point = start.spawn(ecc, rr, offset);
+      placeGpuSlot(i, start, point, offset);
+    };
+    // Like slots start together, from a few scalar multiplications
+    auto initGpuSlots = [&](int from, int to) {
+      std::map<std::pair<int, uint32_t>, std::vector<int>> groups;
+      for (int i = from; i < to; i++) {
+        Herd herd = herdOf(i);
+        groups[{(int)herd, isTameHerd(herd) ? 0 : gpuTargets[i]}].push_back(i);
+      }
+      std::vector<AffinePoint> starts;
+      std::vector<Distance<4>> offsets;
+      for (const auto& group : groups) {
+        const std::vector<int>& slots = group.second;
+        HerdStart start = slotStart(slots[0]);
+        starts.resize(slots.size());
+        offsets.resize(slots.size());
+        uint64_t seed = mpz_class(rr.get_z_bits(64)).get_ui();
+        if (!start.fill(slots.size(), seed, starts.data(), offsets.data())) {
+          for (int i : slots)
+            initGpuSlot(i);
+          continue;
+        }
+        long n = (long)slots.size();
+#pragma omp parallel for
+        for (long j = 0; j < n; j++)
+          placeGpuSlot(slots[j], start, starts[j], offsets[j]);
+      }
+    };
+
+    if (loadedFromCheckpoint && !batchHerd.empty()) {
       std::cout << "Restoring GPU state from checkpoint..." << std::endl;
-      gpuPoints = savedGpuPoints;
-      gpuDists = savedGpuDists;
-      // Check if batch size matches
-      if (gpuPoints.size() != (size_t)gpuBatchSize * 64) {
+      if (batchHerd.size() != (size_t)gpuBatchSize) {
+        // Keep the walks that fit and start the others afresh
         std::cout << "Warning: Checkpoint batch size mismatch. Resizing..."
                   << std::endl;
-        // This is complex. If batch size changed, we can't easily map.
-        // For now, assume user keeps same batch size or we restart if mismatch.
-        // Actually, we can just use the saved points and ignore the rest if
-        // batch size decreased, or fill with random if increased. Let's just
-        // warn and proceed with what we have, resizing if needed.
-        gpuPoints.resize(gpuBatchSize * 64);
-        gpuDists.resize(gpuBatchSize * 32);
-        // Re-init new slots if any
-        // ... (omitted for brevity, assuming user keeps params)
+        HerdStore resized(gpuBatchSize, 4);
+        size_t kept = std::min(batchHerd.size(), resized.size());
+        resized.copyFrom(batchHerd, 0, kept);
+        batchHerd = std::move(resized);
+        initGpuSlots((int)kept, gpuBatchSize);
       }
     } else {
-      std::cout << "Generating " << gpuBatchSize << " kangaroos for GPU..."
+      std::cout << "Generating " << gpuBatchSize << " kangaroos for the "
+                << backend->name() << " backend..."
                 << std::endl;
 
-      gpuPoints.resize(gpuBatchSize * 64);
-      gpuDists.resize(gpuBatchSize * 32);
-
-      // Init random points ONCE
-      gmp_randclass rr(gmp_randinit_default);
-      rr.seed(time(NULL));
-
-      for (int i = 0; i < gpuBatchSize; i++) {
-        mpz_class offset = rr.get_z_range(rangeSize);
-        bool isTame = (i % 2 == 0);
-
-        mpz_class startD;
-        secp256k1_pubkey pt;
+      batchHerd = HerdStore(gpuBatchSize, 4);
+      initGpuSlots(0, gpuBatchSize);
+    }
+    std::cout << "Herd arena: " << (batchHerd.arenaBytes() >> 10) << " KiB"
+              << (batchHerd.hugePages() ? " on huge pages" : "") << std::endl;
 
-        if (isTame) {
-          mpz_class base = endRange;
-          startD = base + offset;
-          unsigned char scalar[32];
-          Utils::mpzToBytes(startD.get_mpz_t(), scalar);
-          ecc.getPubKeyFromPriv(pt, scalar);
-        } else {
-          startD = offset;
-          secp256k1_pubkey p = targetPubKey;
-          unsigned char scalar[32];
-          Utils::mpzToBytes(offset.get_mpz_t(), scalar);
-          ecc.addScalar(p, scalar);
-          pt = p;
+    if (!dpSink) {
+      initDPTable();
+      openJournal();
+    }
+    walkersPerProducer = gpuBatchSize;
+    startDPPipeline(1);
+    std::cout << "Entering batch solver loop..." << std::endl;
+    metrics.bindThread();
+    const DPDistance startBase = DPDistance::fromMpz(startRange);
+    size_t halfSolved[2] = {0, 0};
+    uint64_t gpuDead = 0;
+    std::vector<int> dead;
+    std::vector<int> respawn;  // Dead slots waiting for their half to land
+
+    // The batch walks in two halves that take turns: while the backend
+    // steps one, this thread stores the other's DPs and respawns its
+    // kangaroos. Half h holds slots [halfBegin[h], halfBegin[h + 1]).
+    const int halfBegin[3] = {0, (gpuBatchSize + 1) / 2, gpuBatchSize};
+    std::vector<ComputeBackend::FoundDP> halfFound[2];
+    std::future<void> halfStep[2];
+
+    auto launch = [&](int h) {
+      halfFound[h].clear();
+      halfStep[h] = backend->submitStep(
+          batchHerd, halfBegin[h], halfBegin[h + 1] - halfBegin[h],
+          stepsPerLaunch, dpBits, negationMap, halfFound[h]);
+    };
+
+    auto waitFor = [&](int h) {
+      uint64_t startNs = Metrics::nowNs();
+      halfStep[h].wait();
+      metrics.add(Metrics::BackendWaitNs, Metrics::nowNs() - startNs);
+    };
+
+    // Waits for half h's launch, if any, and handles its DPs
+    auto land = [&](int h) {
+      if (!halfStep[h].valid())
+        return;
+      waitFor(h);
+      halfStep[h].get();  // Rethrows backend errors
+
+      int begin = halfBegin[h], end = halfBegin[h + 1];
+      metrics.add(Metrics::Jumps, (uint64_t)(end - begin) * stepsPerLaunch);
+
+      for (const auto& dp : halfFound[h]) {
+        int i = (int)dp.id;
+        FieldElement x = FieldElement::fromBytes(dp.x.data());
+        if (::isDistinguished(x, dpBits)) {
+          // Batch distances are absolute for tame kangaroos
+          Herd herd = herdOf(i);
+          DPDistance dist = DPDistance::fromBytes(dp.dist.data());
+          if (centered()) {
+            // Signed, as scalars mod N
+            mpz_class d;
+            Utils::bytesToMpz(d.get_mpz_t(), dp.dist.data());
+            if (d > groupOrder / 2)
+              d -= groupOrder;
+            dist = DPDistance::fromSignedMpz(d);
+          } else if (isTameHerd(herd)) {
+            dist -= startBase;
+          }
+          pushDP(0, x, dist, herdTag(herd, gpuTargets[i]), walkerId(0, i));
         }
-
-        // Store Dist
-        std::vector<unsigned char> dBytes(32);
-        Utils::mpzToBytes(startD.get_mpz_t(), dBytes.data());
-        std::memcpy(gpuDists.data() + i * 32, dBytes.data(), 32);
-
-        // Store Point
-        std::vector<unsigned char> pub = ecc.serializePublicKey(pt, false);
-        std::memcpy(gpuPoints.data() + i * 64, pub.data() + 1, 32);
-        std::memcpy(gpuPoints.data() + i * 64 + 32, pub.data() + 33, 32);
+        // Negation-map walks restart after each DP, as on the CPU
+        if (negationMap)
+          initGpuSlot(i);
       }
-    }
-
-    std::cout << "Entering GPU Solver Loop..." << std::endl;
-
-    // Main GPU Loop
-    while (!shouldStop) {
-      if (checkpointRequested) {
-        savedGpuPoints = gpuPoints;
-        savedGpuDists = gpuDists;
-        saveCheckpoint(checkpointFile);
-        checkpointRequested = false;
+      if (negationMap) {
+        for (int i = begin; i < end; i++) {
+          gpuWalkLength[i] += stepsPerLaunch;
+          if (gpuWalkLength[i] > maxWalkLength()) {
+            initGpuSlot(i);
+            cycleRestarts++;
+          }
+        }
       }
 
-      // Run steps
-      std::vector<MetalAccelerator::FoundDP> foundDPs;
-      metalAccel.runStep(gpuPoints, gpuDists, stepsPerLaunch, dpBits, foundDPs);
-
-      // Update stats
-      totalJumps += (uint64_t)gpuBatchSize * stepsPerLaunch;
-
-      // Process found DPs from GPU
-      for (const auto& dp : foundDPs) {
-        // Reconstruct point
-        std::vector<unsigned char> pub(65);
-        pub[0] = 0x04;
-        std::memcpy(pub.data() + 1, dp.x.data(), 32);
-        std::memcpy(pub.data() + 33, dp.y.data(), 32);
-
-        secp256k1_pubkey pt;
-        if (ecc.parsePublicKey(pt, pub)) {
-          if (isDistinguished(pt)) {
-            mpz_class dist;
-            unsigned char dBuf[32];
-            std::memcpy(dBuf, dp.dist.data(), 32);
-            Utils::bytesToMpz(dist.get_mpz_t(), dBuf);
-
-            bool isTame = (dp.id % 2 == 0);
-            std::string hex =
-                Utils::bytesToHex(ecc.serializePublicKey(pt, true));
-
-            {
-              std::lock_guard<std::mutex> lock(mapMutex);
-              processCollision(hex, dist, isTame);
-              if (found)
-                break;
-            }
+      // Send the wilds of solved targets after the others
+      if (solvedCount != halfSolved[h]) {
+        halfSolved[h] = solvedCount;
+        for (int i = begin; i < end; i++) {
+          if (!isTameHerd(herdOf(i)) && solved[gpuTargets[i]]) {
+            gpuTargets[i] = nextUnsolvedTarget(gpuTargets[i]);
+            initGpuSlot(i);
           }
         }
       }
 
-      if (found) {
-        shouldStop = true;
-        return;  // Done!
+      if (deadQueued != gpuDead) {
+        gpuDead = deadQueued;
+        takeDead(0, dead);
+        respawn.insert(respawn.end(), dead.begin(), dead.end());
+        std::sort(respawn.begin(), respawn.end());
+        respawn.erase(std::unique(respawn.begin(), respawn.end()),
+                      respawn.end());
       }
+      auto mine = std::partition(respawn.begin(), respawn.end(),
+                                 [&](int i) { return i < begin || i >= end; });
+      for (auto it = mine; it != respawn.end(); ++it)
+        initGpuSlot(*it);
+      metrics.add(Metrics::DeadKangaroos, respawn.end() - mine);
+      respawn.erase(mine, respawn.end());
+    };
+
+    int h = 0;  // The half in flight
+    int frozenHalves = 0;  // Of checkpointHerd, for the next checkpoint
+    launch(0);
+    while (!shouldStop && !found) {
+      waitFor(h);
+      launch(1 - h);
+      land(h);
+
+      // Checkpoints copy each half as it lands, then write in the
+      // background while both walk on
+      if (checkpointRequested && !dpSink && !checkpointWriting) {
+        uint64_t startNs = Metrics::nowNs();
+        if (checkpointHerd.size() != batchHerd.size())
+          checkpointHerd = HerdStore(batchHerd.size(), 4);
+        checkpointHerd.copyFrom(batchHerd, halfBegin[h],
+                                halfBegin[h + 1] - halfBegin[h]);
+        if (++frozenHalves == 2) {
+          beginCheckpoint(checkpointFile, checkpointHerd);
+          checkpointRequested = false;
+          frozenHalves = 0;
+        }
+        metrics.add(Metrics::CheckpointStallNs, Metrics::nowNs() - startNs);
+      }
+      h = 1 - h;
     }
+    land(h);
 
-    // Save state on exit if requested or stopped
-    savedGpuPoints = gpuPoints;
-    savedGpuDists = gpuDists;
+    stopDPPipeline();
+    printWalkStats();
+    if (found)
+      shouldStop = true;
     return;  // GPU finished (found or stopped)
   }
 
-  // cpu_fallback:
+  // cpu_fallback: distances need the range plus headroom for the walk
+  size_t rangeBits = mpz_sizeinbase(rangeSize.get_mpz_t(), 2);
+  size_t distBits = std::max(rangeBits + 2, rangeBits / 2 + 40);
+  std::cout << "Distance width: "
+            << (distBits <= 64 ? 64 : distBits <= 128 ? 128 : 192) << " bits"
+            << std::endl;
+
+  if (distBits > (size_t)DPTable::kDistanceBits)
+    throw std::runtime_error("Range too large for the CPU walker");
+
+  initJumpTable((double)numThreads * cpuHerdSize);
+  if (!dpSink) {
+    // A precompute keeps every DP it collects
+    initDPTable(mode == Mode::Precompute ? tameDbTarget : 0);
+    openJournal();
+  }
+  startDPPipeline(numThreads);
+  if (distBits <= 64)
+    runCpuHerds<1>();
+  else if (distBits <= 128)
+    runCpuHerds<2>();
+  else
+    runCpuHerds<3>();
+  stopDPPipeline();
+  printWalkStats();
+
+  if (mode == Mode::Precompute) {
+    if (dpTableFull) {
+      throw std::runtime_error("DP table full after " +
+                               std::to_string(dpTable->size()) + " of " +
+                               std::to_string(tameDbTarget) +
+                               " tame DPs, no database written");
+    }
+    writeTameDatabase();
+  }
+}
+
+void Kangaroo::printWalkStats() {
+  if (negationMap) {
+    std::cout << "\nEscaped " << cycleEscapes
+              << " fruitless cycles, restarted " << cycleRestarts << " walks"
+              << std::endl;
+  }
+  uint64_t dead = metrics.total(Metrics::DeadKangaroos);
+  if (dead > 0) {
+    std::cout << "\nRespawned " << dead
+              << " kangaroos that had merged into another's trail"
+              << std::endl;
+  }
+}
+
+template <int Limbs>
+void Kangaroo::runCpuHerds() {
+  typedef Distance<Limbs> Dist;
+
   omp_set_num_threads(numThreads);
 
+  std::vector<AffinePoint> jumpPoints(jumpTable.size());
+  std::vector<Dist> jumpDists(jumpTable.size());
+  for (size_t i = 0; i < jumpTable.size(); i++) {
+    jumpPoints[i] = jumpTable[i].affine;
+    jumpDists[i] = Dist::fromMpz(jumpTable[i].dist);
+  }
+  const Dist escapeDist = Dist::fromMpz(escapeJump.dist);
+  // Centred walks have signed distances: sign-extend them into DP records
+  const bool signedDists = centered();
+
+  // Round the herd up to whole SIMD lanes
+  int lanes = HerdStepper(jumpPoints.data(), jumpPoints.size()).laneWidth();
+  int herdSize = cpuHerdSize < 1 ? 1 : cpuHerdSize;
+  herdSize = (herdSize + lanes - 1) / lanes * lanes;
+  int herdTotal = numThreads * herdSize;
+  walkersPerProducer = herdSize;
+  int tameTotal = mode == Mode::Precompute ? herdTotal : 0;
+  for (int k = 0; k < herdSize && mode == Mode::Search; k++)
+    tameTotal += isTameHerd(herdOf(k)) ? numThreads : 0;
+  std::cout << "Starting " << numThreads << " CPU herds of " << herdSize
+            << " kangaroos (" << tameTotal << " Tame, "
+            << herdTotal - tameTotal << " Wild), "
+            << HerdStepper(jumpPoints.data(), jumpPoints.size()).isaName()
+            << " step kernel." << std::endl;
+
+  // Every herd in one arena; each thread first touches its own slice
+  HerdStore store(herdTotal, Limbs);
+  if (store.hugePages()) {
+    std::cout << "Herd arena: " << (store.arenaBytes() >> 20)
+              << " MiB on huge pages" << std::endl;
+  }
+
 #pragma omp parallel
   {
     int id = omp_get_thread_num();
-    bool isTame = (id < tameCount);
+    metrics.bindThread();
+
+    // Herd state. Slots cycle through the herds (as on the GPU), unless
+    // the mode needs a single type.
+    AffinePoint* points = store.points() + (size_t)id * herdSize;
+    Dist* dists = store.distances<Dist>() + (size_t)id * herdSize;
+    std::vector<int> jumpIdx(herdSize);
+    std::vector<uint32_t> slotTargets(herdSize);  // Wild slots
+    HerdStepper stepper(jumpPoints.data(), jumpPoints.size());
+
+    // Negation map: x of the previous two points, to spot 2-cycles
+    // and the jumps since the last restart
+    std::vector<FieldElement> lastX, lastX2;
+    std::vector<uint64_t> walkLength;
+    if (negationMap) {
+      lastX.assign(herdSize, FieldElement::zero());
+      lastX2.assign(herdSize, FieldElement::zero());
+      walkLength.assign(herdSize, 0);
+    }
 
-    mpz_class startDist = 0;
-    secp256k1_pubkey startPoint;
+    // Keep the even-y representative of {P, -P}
+    auto canonicalize = [&](int k) {
+      if (points[k].y.isOdd()) {
+        Field::neg(points[k].y, points[k].y);
+        dists[k].negate();
+      }
+    };
 
     gmp_randclass rr(gmp_randinit_default);
-    rr.seed(time(NULL) + id);
-    mpz_class offset = rr.get_z_range(rangeSize / 100 + 1);  // Small offset
-
-    if (isTame) {
-      // Tame starts at End to be ahead of Wild
-      mpz_class base = endRange;
-      mpz_class myStart = base + offset;
-      startDist = myStart;  // This is the absolute scalar value
-
-      unsigned char scalar[32];
-      Utils::mpzToBytes(myStart.get_mpz_t(), scalar);
-      ecc.getPubKeyFromPriv(startPoint, scalar);
-    } else {
-      // Wild
-      startDist = offset;  // We track distance ADDED to Target
-
-      secp256k1_pubkey p = targetPubKey;
-      unsigned char scalar[32];
-      Utils::mpzToBytes(offset.get_mpz_t(), scalar);
-      ecc.addScalar(p, scalar);
-      startPoint = p;
+    rr.seed(streamSeed(RngStream::CpuHerd, id));
+
+    auto isTame = [&](int k) {
+      return mode == Mode::Precompute ||
+             (mode == Mode::Search && isTameHerd(herdOf(k)));
+    };
+    auto tagOf = [&](int k) {
+      if (mode == Mode::Search)
+        return herdTag(herdOf(k), slotTargets[k]);
+      return isTame(k) ? DPTable::kTagTame : DPTable::wildTag(slotTargets[k]);
+    };
+
+    // Precompute and solve walks restart at a random point after each DP
+    // (Bernstein-Lange), and so do negation-map walks (Galbraith-Ruprai):
+    // they go back and forth instead of drifting, so a wild would take
+    // long to reach the tames. Other searches start once and run until the
+    // end.
+    auto startOf = [&](int k) {
+      HerdStart start;
+      if (mode == Mode::Precompute)
+        start.spread = rangeSize;
+      else if (mode == Mode::Solve)
+        start.spread = rangeSize / 8 + 1;
+      else
+        start.spread = rangeSize / 100 + 1;  // Small offset
+
+      if (herds > 2) {
+        // Tames from the centre, wilds from +-(key - center). With four
+        // herds every jump is even: tames of the second herd take the odd
+        // points, and the two wild herds meet whatever the key's parity.
+        Herd herd = herdOf(k);
+        start.even = herds == 4;
+        if (herd == Herd::SecondTame)
+          start.base = 1;
+        if (!isTameHerd(herd)) {
+          const std::vector<secp256k1_pubkey>& from =
+              herd == Herd::Wild ? walkTargets : negatedWalkTargets;
+          start.anchor = &from[slotTargets[k]];
+        }
+      } else if (isTame(k) && negationMap) {
+        // Anywhere in the centred interval, holding key - center
+        start.base = -(rangeSize / 2);
+        start.spread = rangeSize + 1;
+      } else if (isTame(k)) {
+        // Searches start tames at End to be ahead of Wild
+        start.base = mode == Mode::Precompute ? startRange : endRange;
+      } else if (negationMap) {
+        // Anywhere within W/4 of the target
+        start.anchor = &walkTargets[slotTargets[k]];
+        start.base = -(rangeSize / 4);
+        start.spread = rangeSize / 2 + 1;
+      } else {
+        // Wild: the distance is added to the target
+        start.anchor = &walkTargets[slotTargets[k]];
+      }
+      return start;
+    };
+    auto place = [&](int k, const HerdStart& start, const AffinePoint& point,
+                     const Distance<4>& offset) {
+      // Plain tames hold their distance from Start
+      bool fromStart = isTame(k) && !centered();
+      dists[k] = Dist::fromSignedMpz(fromStart ? start.base - startRange
+                                               : start.base);
+      dists[k] += Dist::from(offset);
+      points[k] = point;
+      if (negationMap) {
+        canonicalize(k);
+        lastX[k] = lastX2[k] = FieldElement::zero();
+        walkLength[k] = 0;
+      }
+    };
+    auto spawn = [&](int k) {
+      HerdStart start = startOf(k);
+      Distance<4> offset;
+      AffinePoint point = start.spawn(ecc, rr, offset);
+      place(k, start, point, offset);
+    };
+
+    // Wilds are dealt round-robin over the targets. Like slots start
+    // together, from a few scalar multiplications.
+    std::map<std::pair<int, uint32_t>, std::vector<int>> groups;
+    for (int k = 0, next = id; k < herdSize; k++) {
+      if (!isTame(k))
+        slotTargets[k] = next++ % targets.size();
+      groups[{(int)herdOf(k) * 2 + isTame(k), isTame(k) ? 0 : slotTargets[k]}]
+          .push_back(k);
     }
+    std::vector<AffinePoint> starts;
+    std::vector<Distance<4>> offsets;
+    for (const auto& group : groups) {
+      const std::vector<int>& slots = group.second;
+      HerdStart start = startOf(slots[0]);
+      starts.resize(slots.size());
+      offsets.resize(slots.size());
+      uint64_t seed = mpz_class(rr.get_z_bits(64)).get_ui();
+      if (start.fill(slots.size(), seed, starts.data(), offsets.data())) {
+        for (size_t j = 0; j < slots.size(); j++)
+          place(slots[j], start, starts[j], offsets[j]);
+      } else {
+        for (int k : slots)
+          spawn(k);
+      }
+    }
+    size_t herdSolved = 0;
+    uint64_t herdDead = 0;
+    std::vector<int> dead;
+
+    // Worker Loop: every kangaroo of the herd jumps once per iteration and
+    // all (Jump.x - P.x) denominators share a single field inversion.
+    bool alive = true;
+    while (alive && !shouldStop) {
+      // Send the wilds of solved targets after the others
+      if (solvedCount != herdSolved) {
+        herdSolved = solvedCount;
+        for (int k = 0; k < herdSize; k++) {
+          if (!isTame(k) && solved[slotTargets[k]]) {
+            slotTargets[k] = nextUnsolvedTarget(slotTargets[k]);
+            spawn(k);
+          }
+        }
+      }
+      if (deadQueued != herdDead) {
+        herdDead = deadQueued;
+        takeDead(id, dead);
+        for (int k : dead)
+          spawn(k);
+        metrics.add(Metrics::DeadKangaroos, dead.size());
+      }
 
-    // Worker Loop
-    mpz_class currentDist = startDist;
-    secp256k1_pubkey currentPoint = startPoint;
-    mpz_class dist = currentDist;
-
-    int jumpTableSize = jumpTable.size();
-
-    while (!shouldStop) {
-      std::vector<unsigned char> ser =
-          ecc.serializePublicKey(currentPoint, true);
-      unsigned char h = ser.back();
-      int idx = h % jumpTableSize;
-
-      const Jump& jump = jumpTable[idx];
-      ecc.addPoints(currentPoint, jump.point);
-      dist += jump.dist;
-      totalJumps++;
-
-      if (isDistinguished(currentPoint)) {
-        std::string hex = Utils::bytesToHex(ser);
-        {
-          std::lock_guard<std::mutex> lock(mapMutex);
-          if (shouldStop)
-            break;
-          processCollision(hex, dist, isTame);
+      // P == -Jump is only possible with a degenerate range
+      alive = stepper.step(points, herdSize, jumpIdx.data());
+
+      for (int k = 0; k < herdSize; k++) {
+        dists[k] += jumpDists[jumpIdx[k]];
+
+        if (negationMap) {
+          canonicalize(k);
+          if (points[k].x == lastX2[k] && points[k].x < lastX[k]) {
+            // P -> -(P + J) -> P: leave from the smaller x of the two with
+            // the escape jump and its own (as on the GPU), so that every
+            // walk entering the cycle leaves it the same way
+            int i = jumpIndex(points[k].x, jumpPoints.size());
+            alive = Field::addPoints(points[k], escapeJump.affine) && alive;
+            alive = Field::addPoints(points[k], jumpPoints[i]) && alive;
+            dists[k] += escapeDist;
+            dists[k] += jumpDists[i];
+            canonicalize(k);
+            cycleEscapes++;
+          }
+          lastX2[k] = lastX[k];
+          lastX[k] = points[k].x;
+          if (++walkLength[k] > maxWalkLength()) {
+            spawn(k);
+            cycleRestarts++;
+          }
+        }
+
+        if (isDistinguished(points[k])) {
+          DPDistance dist = signedDists ? DPDistance::fromSigned(dists[k])
+                                        : DPDistance::from(dists[k]);
+          pushDP(id, points[k].x, dist, tagOf(k), walkerId(id, k));
+          if (mode != Mode::Search || negationMap)
+            spawn(k);
         }
       }
 
-      if (totalJumps % 1000 == 0 && shouldStop)
-        break;
+      metrics.add(Metrics::Jumps, herdSize);
+      if (mode == Mode::Precompute && dpTable->size() >= tameDbTarget)
+        shouldStop = true;
     }
   }
 }
@@ -111,7 +111,8 @@ MetalAccelerator::~MetalAccelerator() {
   // ARC handles release
 }
 
-void MetalAccelerator::init(const std::vector<Jump> &jumpTable) {
+void MetalAccelerator::init(const std::vector<Jump> &jumpTable,
+                            const Jump &escape) {
   // Upload jump table to GPU Buffers
   // Structure of Arrays: X[], Y[], Dist[]
 
@@ -121,7 +122,9 @@ void MetalAccelerator::init(const std::vector<Jump> &jumpTable) {
 
   ECC ecc; // Temp ecc for context
 
-  for (const auto &jump : jumpTable) {
+  std::vector<Jump> jumps = jumpTable;
+  jumps.push_back(escape);
+  for (const auto &jump : jumps) {
     // Dist
     copyBigIntToBuffer(jump.dist, tableDist);
 
@@ -150,9 +153,9 @@ void MetalAccelerator::init(const std::vector<Jump> &jumpTable) {
   tableSize = (uint32_t)jumpTable.size();
 }
 
-void MetalAccelerator::runStep(std::vector<unsigned char> &points,
-                               std::vector<unsigned char> &distances,
-                               int numSteps, int dpBits,
+void MetalAccelerator::runStep(HerdStore &herd, uint32_t begin,
+                               uint32_t count, int numSteps, int dpBits,
+                               bool negationMap,
                                std::vector<FoundDP> &foundDPs) {
   if (!computePipelineState) {
     std::cerr
@@ -161,27 +164,19 @@ void MetalAccelerator::runStep(std::vector<unsigned char> &points,
     return;
   }
 
-  NSUInteger count = points.size() / 64; // X + Y (32+32)
   if (count == 0)
     return;
 
-  std::vector<unsigned char> bufX;
-  std::vector<unsigned char> bufY;
-  std::vector<unsigned char> bufDist;
-  bufX.reserve(count * 32);
-  bufY.reserve(count * 32);
-  bufDist.reserve(count * 32);
-
+  // The kernel takes little-endian X, Y and distance arrays: the herd's
+  // limbs, on a little-endian host
+  AffinePoint *points = herd.points() + begin;
+  std::vector<unsigned char> bufX(count * 32);
+  std::vector<unsigned char> bufY(count * 32);
+  std::vector<unsigned char> bufDist(count * 32);
   for (size_t i = 0; i < count; i++) {
-    // Copy X (Reverse to Little Endian)
-    for (int j = 0; j < 32; j++)
-      bufX.push_back(points[i * 64 + 31 - j]);
-    // Copy Y (Reverse to Little Endian)
-    for (int j = 0; j < 32; j++)
-      bufY.push_back(points[i * 64 + 63 - j]);
-    // Copy Dist (Reverse to Little Endian)
-    for (int j = 0; j < 32; j++)
-      bufDist.push_back(distances[i * 32 + 31 - j]);
+    std::memcpy(&bufX[i * 32], points[i].x.v, 32);
+    std::memcpy(&bufY[i * 32], points[i].y.v, 32);
+    std::memcpy(&bufDist[i * 32], herd.distance(begin + i), 32);
   }
 
   id<MTLBuffer> bufferX =
@@ -198,7 +193,7 @@ void MetalAccelerator::runStep(std::vector<unsigned char> &points,
                          options:MTLResourceStorageModeShared];
 
   // Found DPs buffers
-  uint32_t maxFound = 4096;
+  uint32_t maxFound = maxFoundDPs();
   id<MTLBuffer> foundX =
       [device newBufferWithLength:maxFound * 32
                           options:MTLResourceStorageModeShared];
@@ -245,6 +240,8 @@ void MetalAccelerator::runStep(std::vector<unsigned char> &points,
   uint32_t dpBitsVal = (uint32_t)dpBits;
   [computeEncoder setBytes:&dpBitsVal length:sizeof(uint32_t) atIndex:13];
   [computeEncoder setBytes:&maxFound length:sizeof(uint32_t) atIndex:14];
+  uint32_t negationVal = negationMap ? 1 : 0;
+  [computeEncoder setBytes:&negationVal length:sizeof(uint32_t) atIndex:15];
 
   MTLSize gridSize = MTLSizeMake(count, 1, 1);
   id<MTLComputePipelineState> pso =
@@ -275,22 +272,14 @@ void MetalAccelerator::runStep(std::vector<unsigned char> &points,
     return;
   }
 
-  // Copy back results (interleave X/Y)
+  // Copy back results
   unsigned char *ptrX = (unsigned char *)[bufferX contents];
   unsigned char *ptrY = (unsigned char *)[bufferY contents];
-
-  for (size_t i = 0; i < count; i++) {
-    // Reverse back to Big Endian
-    for (int j = 0; j < 32; j++)
-      points[i * 64 + j] = ptrX[i * 32 + 31 - j];
-    for (int j = 0; j < 32; j++)
-      points[i * 64 + 32 + j] = ptrY[i * 32 + 31 - j];
-  }
-
   unsigned char *ptrDist = (unsigned char *)[bufferDist contents];
   for (size_t i = 0; i < count; i++) {
-    for (int j = 0; j < 32; j++)
-      distances[i * 32 + j] = ptrDist[i * 32 + 31 - j];
+    std::memcpy(points[i].x.v, ptrX + i * 32, 32);
+    std::memcpy(points[i].y.v, ptrY + i * 32, 32);
+    std::memcpy(herd.distance(begin + i), ptrDist + i * 32, 32);
   }
 
   // Process Found DPs
@@ -308,7 +297,7 @@ void MetalAccelerator::runStep(std::vector<unsigned char> &points,
 
   for (uint32_t i = 0; i < numFound; i++) {
     FoundDP dp;
-    dp.id = fIds[i];
+    dp.id = begin + fIds[i];
     dp.x.resize(32);
     dp.y.resize(32);
     dp.dist.resize(32);
@@ -0,0 +1,182 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <stdexcept>
+
+std::atomic<uint64_t> Metrics::instances{0};
+thread_local uint64_t Metrics::boundTo = 0;
+thread_local Metrics::Slot* Metrics::boundSlot = nullptr;
+
+const char* Metrics::name(Counter c) {
+  static const char* const names[kCounters] = {
+      "jumps",           "dps",
+      "table_inserts",   "table_probes",
+      "tame_collisions", "wild_collisions",
+      "candidates",      "false_candidates",
+      "dead_kangaroos",  "queue_full",
+      "queue_wait_ns",   "lock_wait_ns",
+      "checkpoints",     "checkpoint_ns",
+      "backend_wait_ns", "checkpoint_stall_ns"};
+  return names[c];
+}
+
+const char* Metrics::name(Gauge g) {
+  static const char* const names[kGauges] = {
+      "dp_table_entries", "dp_table_capacity", "expected_jumps",
+      "dp_spilled_entries", "dp_runs"};
+  return names[g];
+}
+
+void Metrics::bindThread() {
+  if (boundTo == id)
+    return;
+  int slot = usedSlots.fetch_add(1, std::memory_order_relaxed);
+  if (slot >= kSlots) {
+    usedSlots.store(kSlots, std::memory_order_relaxed);
+    return;  // Stay on the shared slot
+  }
+  boundSlot = &slots[slot];
+  boundTo = id;
+}
+
+uint64_t Metrics::total(Counter c) const {
+  int n = std::min(usedSlots.load(std::memory_order_relaxed), kSlots);
+  uint64_t sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += slots[i].v[c].load(std::memory_order_relaxed);
+  return sum;
+}
+
+Metrics::Snapshot Metrics::snapshot() const {
+  Snapshot s;
+  for (int c = 0; c < kCounters; c++)
+    s.counters[c] = total((Counter)c);
+  for (int g = 0; g < kGauges; g++)
+    s.gauges[g] = gauges[g].load(std::memory_order_relaxed);
+  return s;
+}
+
+MetricsExporter::MetricsExporter(const Metrics& metrics,
+                                 const std::string& path, Format format,
+                                 double intervalSeconds)
+    : metrics(metrics),
+      path(path),
+      format(format),
+      interval(intervalSeconds > 0 ? intervalSeconds : 10) {
+  if (path == "-") {
+    out = stdout;
+  } else if (format == Format::Json) {
+    out = fopen(path.c_str(), "a");
+    if (!out)
+      throw std::runtime_error("Cannot open " + path);
+  } else {
+    FILE* f = fopen((path + ".tmp").c_str(), "w");
+    if (!f)
+      throw std::runtime_error("Cannot write " + path + ".tmp");
+    fclose(f);
+  }
+}
+
+MetricsExporter::~MetricsExporter() {
+  stop();
+  if (out && out != stdout)
+    fclose(out);
+}
+
+bool MetricsExporter::parseFormat(const std::string& s, Format& format) {
+  if (s == "json")
+    format = Format::Json;
+  else if (s == "prom" || s == "prometheus")
+    format = Format::Prometheus;
+  else
+    return false;
+  return true;
+}
+
+void MetricsExporter::start() {
+  startTime = std::chrono::steady_clock::now();
+  thread = std::thread(&MetricsExporter::loop, this);
+}
+
+void MetricsExporter::stop() {
+  if (!thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cv.notify_one();
+  thread.join();
+}
+
+void MetricsExporter::loop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto period = std::chrono::duration<double>(interval);
+  while (!cv.wait_for(lock, period, [&] { return stopping; })) {
+    lock.unlock();
+    write();
+    lock.lock();
+  }
+  write();
+}
+
+void MetricsExporter::write() {
+  Metrics::Snapshot s = metrics.snapshot();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - startTime)
+                       .count();
+  uint64_t jumps = s.counters[Metrics::Jumps];
+  double rate = seconds > lastSeconds
+                    ? (double)(jumps - lastJumps) / (seconds - lastSeconds)
+                    : 0;
+  lastJumps = jumps;
+  lastSeconds = seconds;
+
+  if (format == Format::Json) {
+    fprintf(out, "{\"time\":%.3f,\"uptime\":%.3f,\"jumps_per_second\":%.1f",
+            std::chrono::duration<double>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count(),
+            seconds, rate);
+    for (int c = 0; c < Metrics::kCounters; c++) {
+      fprintf(out, ",\"%s\":%" PRIu64, Metrics::name((Metrics::Counter)c),
+              s.counters[c]);
+    }
+    for (int g = 0; g < Metrics::kGauges; g++) {
+      fprintf(out, ",\"%s\":%.0f", Metrics::name((Metrics::Gauge)g),
+              s.gauges[g]);
+    }
+    fprintf(out, "}\n");
+    fflush(out);
+    return;
+  }
+
+  // Prometheus: a file is rewritten whole, so that scrapers never see a
+  // partial sample
+  std::string tmp = path + ".tmp";
+  FILE* f = out ? out : fopen(tmp.c_str(), "w");
+  if (!f)
+    return;
+  fprintf(f, "# TYPE silikangaroo_uptime_seconds gauge\n");
+  fprintf(f, "silikangaroo_uptime_seconds %.3f\n", seconds);
+  fprintf(f, "# TYPE silikangaroo_jumps_per_second gauge\n");
+  fprintf(f, "silikangaroo_jumps_per_second %.1f\n", rate);
+  for (int c = 0; c < Metrics::kCounters; c++) {
+    const char* n = Metrics::name((Metrics::Counter)c);
+    fprintf(f, "# TYPE silikangaroo_%s_total counter\n", n);
+    fprintf(f, "silikangaroo_%s_total %" PRIu64 "\n", n, s.counters[c]);
+  }
+  for (int g = 0; g < Metrics::kGauges; g++) {
+    const char* n = Metrics::name((Metrics::Gauge)g);
+    fprintf(f, "# TYPE silikangaroo_%s gauge\n", n);
+    fprintf(f, "silikangaroo_%s %.0f\n", n, s.gauges[g]);
+  }
+  if (f == out) {
+    fflush(f);
+  } else {
+    fclose(f);
+    std::rename(tmp.c_str(), path.c_str());
+  }
+}
@@ -0,0 +1,52 @@
+#include "TameDatabase.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "DPTable.hpp"
+
+TameDatabase::TameDatabase(const std::string& file) : reader(file) {
+  const CheckpointHeader& h = reader.header();
+  bool noTarget = std::all_of(h.target, h.target + sizeof(h.target),
+                              [](uint8_t b) { return b == 0; });
+  if (!noTarget || h.jumpCount == 0)
+    throw std::runtime_error(file + " is not a tame database");
+
+  const CheckpointRecord* r = reader.records();
+  for (uint64_t i = 0; i < h.dpCount; i++) {
+    if ((i > 0 && r[i - 1].fp >= r[i].fp) ||
+        !(Checkpoint::tag(r[i]) & DPTable::kTagTame)) {
+      throw std::runtime_error(file + " is not a sorted tame database");
+    }
+  }
+}
+
+bool TameDatabase::find(uint64_t fp, DPDistance& dist) const {
+  const CheckpointRecord* begin = reader.records();
+  const CheckpointRecord* end = begin + reader.header().dpCount;
+  const CheckpointRecord* it = std::lower_bound(
+      begin, end, fp,
+      [](const CheckpointRecord& r, uint64_t key) { return r.fp < key; });
+  if (it == end || it->fp != fp)
+    return false;
+  dist = Checkpoint::distance(*it);
+  return true;
+}
+
+void TameDatabase::write(const std::string& file,
+                         const CheckpointHeader& header,
+                         const std::vector<unsigned char>& jumps,
+                         std::vector<CheckpointRecord>& records) {
+  std::sort(records.begin(), records.end(),
+            [](const CheckpointRecord& a, const CheckpointRecord& b) {
+              return a.fp < b.fp;
+            });
+
+  CheckpointHeader h = header;
+  std::fill(h.target, h.target + sizeof(h.target), 0);
+  CheckpointWriter writer(file, h);
+  writer.writeJumps(jumps.data(), jumps.size() / 32);
+  for (const CheckpointRecord& r : records)
+    writer.writeRecord(r);
+  writer.finish();
+}
@@ -9,6 +9,9 @@ struct uint256 {
     uint32_t v[8];
 };
 
+// Jump table entries cached in threadgroup memory by kangaroo_step
+#define SHARED_JUMPS 256
+
 // Point in Jacobian coordinates
 struct Point {
     uint256 x;
@@ -464,6 +467,24 @@ void scalar_add(thread uint256& c, thread const uint256& a, thread const uint256
     }
 }
 
+// c = N - a (mod N), for the negation map
+void scalar_neg(thread uint256& c, thread const uint256& a) {
+    bool zero = true;
+    for(int i=0; i<8; i++) if(a.v[i]!=0) zero = false;
+    if (zero) { c = a; return; }
+    uint64_t borrow = 0;
+    for(int i=0; i<8; i++) {
+        uint64_t diff = (uint64_t)SECP_N[i] - a.v[i] - borrow;
+        c.v[i] = (uint32_t)diff;
+        borrow = (diff >> 63) & 1;
+    }
+}
+
+bool eq_t(thread const uint256& a, thread const uint256& b) {
+    for(int i=0; i<8; i++) if(a.v[i]!=b.v[i]) return false;
+    return true;
+}
+
 kernel void kangaroo_step(
     device uint256* pointsX [[ buffer(0) ]],
     device uint256* pointsY [[ buffer(1) ]],
@@ -480,21 +501,25 @@ kernel void kangaroo_step(
     device atomic_uint* foundCount [[ buffer(12) ]],
     constant uint& dpBits [[ buffer(13) ]],
     constant uint& maxFound [[ buffer(14) ]],
+    constant uint& negationMap [[ buffer(15) ]],
     uint id [[ thread_position_in_grid ]],
     uint tid [[ thread_index_in_threadgroup ]],
+    uint tgSize [[ threads_per_threadgroup ]],
     ushort lid [[ thread_index_in_simdgroup ]]
 ) {
-    // Shared memory for jump table to reduce global memory bandwidth
-    // Assumes tableSize <= 32. Metal threadgroup memory is fast.
-    threadgroup uint256 sharedTableX[32];
-    threadgroup uint256 sharedTableY[32];
-    threadgroup uint256 sharedTableDist[32];
+    // Shared memory for jump table to reduce global memory bandwidth.
+    // The first SHARED_JUMPS entries (24 KB of the 32 KB threadgroup
+    // memory) are cached, larger tables read the rest from device memory.
+    threadgroup uint256 sharedTableX[SHARED_JUMPS];
+    threadgroup uint256 sharedTableY[SHARED_JUMPS];
+    threadgroup uint256 sharedTableDist[SHARED_JUMPS];
 
     // Cooperative load of jump table
-    if (tid < 32 && tid < tableSize) {
-        sharedTableX[tid] = jumpTableX[tid];
-        sharedTableY[tid] = jumpTableY[tid];
-        sharedTableDist[tid] = jumpTableDist[tid];
+    uint sharedSize = min(tableSize, (uint)SHARED_JUMPS);
+    for (uint j = tid; j < sharedSize; j += tgSize) {
+        sharedTableX[j] = jumpTableX[j];
+        sharedTableY[j] = jumpTableY[j];
+        sharedTableDist[j] = jumpTableDist[j];
     }
     threadgroup_barrier(mem_flags::mem_threadgroup);
 
@@ -506,6 +531,12 @@ kernel void kangaroo_step(
 
     uint32_t dpMask = (1 << dpBits) - 1;
 
+    // Negation map: affine X of the previous two points (this launch only)
+    uint256 prevX1, prevX2;
+    uint history = 0;
+    uint256 zero256;
+    for(int i=0; i<8; i++) zero256.v[i] = 0;
+
     for(uint i=0; i<numSteps; ++i) {
         // Compute Affine X to determine next jump index
         // X_aff = X * Z^-2
@@ -517,6 +548,16 @@ kernel void kangaroo_step(
         uint256 invZ2; mod_sqr(invZ2, invZ);
         uint256 x_aff; mod_mul(x_aff, p.x, invZ2);
 
+        // Negation map: walk on {P, -P} via the even-y representative
+        if (negationMap) {
+            uint256 invZ3; mod_mul(invZ3, invZ2, invZ);
+            uint256 y_aff; mod_mul(y_aff, p.y, invZ3);
+            if (y_aff.v[0] & 1) {
+                mod_sub(p.y, zero256, p.y);
+                scalar_neg(dist, dist);
+            }
+        }
+
         // Check DP on Affine X
         // Only check if we haven't found too many (to avoid buffer overflow)
         // We check the lowest bits of x_aff.v[0]
@@ -536,12 +577,35 @@ kernel void kangaroo_step(
             }
         }
 
-        uint32_t idx = x_aff.v[0] % tableSize;
+        // Bits 32.. of X: the low ones are the DP condition (HerdStepper.hpp)
+        uint32_t idx = x_aff.v[1] & (tableSize - 1);
+
+        // Fruitless 2-cycle P -> -(P + J) -> P: leave from the smaller x
+        // of the two with the escape jump (after the table) and J[idx], as
+        // the CPU walker does
+        if (negationMap) {
+            if (history >= 2 && eq_t(x_aff, prevX2) && !gte_t(x_aff, prevX1)) {
+                uint256 ex = jumpTableX[tableSize];
+                uint256 ey = jumpTableY[tableSize];
+                uint256 ed = jumpTableDist[tableSize];
+                scalar_add(dist, dist, ed);
+                point_add_mixed(p, p, ex, ey);
+            }
+            prevX2 = prevX1;
+            prevX1 = x_aff;
+            history++;
+        }
 
-        // Use shared memory
-        uint256 jx = sharedTableX[idx];
-        uint256 jy = sharedTableY[idx];
-        uint256 jd = sharedTableDist[idx];
+        uint256 jx, jy, jd;
+        if (idx < SHARED_JUMPS) {
+            jx = sharedTableX[idx];
+            jy = sharedTableY[idx];
+            jd = sharedTableDist[idx];
+        } else {
+            jx = jumpTableX[idx];
+            jy = jumpTableY[idx];
+            jd = jumpTableDist[idx];
+        }
 
         scalar_add(dist, dist, jd);
         point_add_mixed(p, p, jx, jy);
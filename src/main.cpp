@@ -1,12 +1,18 @@
+#include <atomic>
 #include <chrono>
 #include <csignal>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "DPClient.hpp"
+#include "DPProtocol.hpp"
 #include "Kangaroo.hpp"
+#include "Metrics.hpp"
 #include "Utils.hpp"
 
 // Global pointer for signal handler
@@ -29,58 +35,172 @@ void signalHandler(int signum) {
   }
 }
 
+// "key1,key2,..." or "@file" with one key per line
+bool parseTargets(const std::string& arg, std::vector<std::string>& keys) {
+  if (!arg.empty() && arg[0] == '@') {
+    std::ifstream in(arg.substr(1));
+    if (!in.is_open())
+      return false;
+    std::string line;
+    while (in >> line) {
+      if (line[0] != '#')
+        keys.push_back(line);
+    }
+  } else {
+    size_t pos = 0;
+    for (;;) {
+      size_t comma = arg.find(',', pos);
+      keys.push_back(arg.substr(pos, comma - pos));
+      if (comma == std::string::npos)
+        break;
+      pos = comma + 1;
+    }
+  }
+  return !keys.empty();
+}
+
 void printUsage() {
   std::cout << "Usage: silikangaroo <public_key_hex> <start_range_hex> "
                "<end_range_hex> [options]\n"
+            << "       silikangaroo --connect <host:port> [options]\n"
+            << "       silikangaroo - <start_range_hex> <end_range_hex> "
+               "--precompute <file> [options]\n"
+            << "<public_key_hex> may list several keys in the same range, "
+               "comma-separated,\n"
+            << "or name a file of keys as @file.\n"
             << "Options:\n"
             << "  --threads <n>       Number of CPU threads (default: auto)\n"
-            << "  --gpu               Enable GPU acceleration\n"
+            << "  --herd <n>          Kangaroos per CPU thread (default: 512)\n"
+            << "  --gpu               Enable GPU acceleration (--backend "
+               "metal)\n"
+            << "  --backend <name>    Walk a batch of kangaroos on: metal, "
+               "cpu\n"
             << "  --dp <n>            DP Bits (default: auto)\n"
-            << "  --batch <n>         GPU Batch size (default: 16384)\n"
-            << "  --steps <n>         GPU Steps per launch (default: 256)\n"
+            << "  --jumps <n>         Jump table size, a power of 2 in "
+               "32..4096 (default: 32,\n"
+            << "                      2048 with --symmetric)\n"
+            << "  --seed <n>          Seed the jump table and herds, for "
+               "reproducible runs\n"
+            << "  --symmetric         Negation map on the centred interval "
+               "(~1.4x fewer jumps)\n"
+            << "  --herds <n>         2, 3 or 4 kangaroo herds (default: 2; "
+               "4 takes ~1.17x\n"
+            << "                      fewer jumps)\n"
+            << "  --batch <n>         Backend batch size (default: 16384)\n"
+            << "  --steps <n>         Backend steps per launch (default: "
+               "256)\n"
+            << "  --dp-memory-limit <MiB> Keep the DP table within this "
+               "much RAM, spilling\n"
+            << "                      sorted runs to <checkpoint>.runs "
+               "(default: no limit)\n"
             << "  --resume <file>     Resume from checkpoint file\n"
             << "  --checkpoint <file> Checkpoint file to save to (default: "
                "kangaroo.checkpoint)\n"
+            << "  --server <port>     Collect DPs from --connect workers\n"
+            << "  --connect <addr>    Work for the DP server at host:port "
+               "(target and range come from the server)\n"
+            << "  --precompute <file> Write a tame DP database for intervals "
+               "of this width\n"
+            << "  --tame-dps <n>      DPs to precompute (default: 65536)\n"
+            << "  --tame-db <file>    Solve against a precomputed tame "
+               "database\n"
+            << "  --metrics <file>    Export counters periodically to a "
+               "file, - for stdout\n"
+            << "  --metrics-format <f> json (JSON lines, default) or prom "
+               "(Prometheus text)\n"
+            << "  --metrics-interval <s> Seconds between samples (default: "
+               "10)\n"
             << "  --help              Show this help\n";
 }
 
 int main(int argc, char* argv[]) {
   signal(SIGINT, signalHandler);
 
-  if (argc < 4) {
+  // Workers may leave out the positional arguments
+  int firstOption = (argc >= 2 && std::strncmp(argv[1], "--", 2) == 0) ? 1 : 4;
+  if (argc < firstOption) {
     printUsage();
     return 1;
   }
 
-  std::string targetPubHex = argv[1];
-  std::string startHex = argv[2];
-  std::string endHex = argv[3];
+  std::string targetPubHex = firstOption == 4 ? argv[1] : "";
+  std::string startHex = firstOption == 4 ? argv[2] : "";
+  std::string endHex = firstOption == 4 ? argv[3] : "";
 
   int threads = -1;
-  bool useGPU = false;
+  int herdSize = -1;
+  std::string backend = "";
+  bool symmetric = false;
+  int herds = 2;
   int dpBits = -1;
+  int jumpTableSize = 0;
+  bool seeded = false;
+  uint64_t seed = 0;
   int gpuBatchSize = 16384;
   int gpuSteps = 256;
+  size_t dpMemoryMiB = 0;
   std::string resumeFile = "";
   std::string checkpointFile = "kangaroo.checkpoint";
+  int serverPort = 0;
+  std::string serverAddress = "";
+  std::string precomputeFile = "";
+  size_t tameDPs = 65536;
+  std::string tameDbFile = "";
+  std::string metricsFile = "";
+  MetricsExporter::Format metricsFormat = MetricsExporter::Format::Json;
+  double metricsInterval = 10;
 
   // Parse optional args
-  for (int i = 4; i < argc; ++i) {
+  for (int i = firstOption; i < argc; ++i) {
     std::string arg = argv[i];
     if (arg == "--gpu") {
-      useGPU = true;
+      backend = "metal";
+    } else if (arg == "--backend" && i + 1 < argc) {
+      backend = argv[++i];
+    } else if (arg == "--symmetric") {
+      symmetric = true;
+    } else if (arg == "--herds" && i + 1 < argc) {
+      herds = std::stoi(argv[++i]);
     } else if (arg == "--threads" && i + 1 < argc) {
       threads = std::stoi(argv[++i]);
+    } else if (arg == "--herd" && i + 1 < argc) {
+      herdSize = std::stoi(argv[++i]);
     } else if (arg == "--dp" && i + 1 < argc) {
       dpBits = std::stoi(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = std::stoull(argv[++i], nullptr, 0);
+      seeded = true;
+    } else if (arg == "--jumps" && i + 1 < argc) {
+      jumpTableSize = std::stoi(argv[++i]);
     } else if (arg == "--batch" && i + 1 < argc) {
       gpuBatchSize = std::stoi(argv[++i]);
     } else if (arg == "--steps" && i + 1 < argc) {
       gpuSteps = std::stoi(argv[++i]);
+    } else if (arg == "--dp-memory-limit" && i + 1 < argc) {
+      dpMemoryMiB = std::stoull(argv[++i]);
     } else if (arg == "--resume" && i + 1 < argc) {
       resumeFile = argv[++i];
     } else if (arg == "--checkpoint" && i + 1 < argc) {
       checkpointFile = argv[++i];
+    } else if (arg == "--server" && i + 1 < argc) {
+      serverPort = std::stoi(argv[++i]);
+    } else if (arg == "--connect" && i + 1 < argc) {
+      serverAddress = argv[++i];
+    } else if (arg == "--precompute" && i + 1 < argc) {
+      precomputeFile = argv[++i];
+    } else if (arg == "--tame-dps" && i + 1 < argc) {
+      tameDPs = std::stoull(argv[++i]);
+    } else if (arg == "--tame-db" && i + 1 < argc) {
+      tameDbFile = argv[++i];
+    } else if (arg == "--metrics" && i + 1 < argc) {
+      metricsFile = argv[++i];
+    } else if (arg == "--metrics-format" && i + 1 < argc) {
+      if (!MetricsExporter::parseFormat(argv[++i], metricsFormat)) {
+        std::cerr << "Unknown metrics format: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (arg == "--metrics-interval" && i + 1 < argc) {
+      metricsInterval = std::stod(argv[++i]);
     } else if (arg == "--help") {
       printUsage();
       return 0;
@@ -95,6 +215,74 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  if (firstOption == 1 && serverAddress.empty()) {
+    printUsage();
+    return 1;
+  }
+  bool tameDbMode = !precomputeFile.empty() || !tameDbFile.empty();
+  if (tameDbMode && (serverPort > 0 || !serverAddress.empty())) {
+    std::cerr << "--precompute and --tame-db cannot be distributed"
+              << std::endl;
+    return 1;
+  }
+  if (tameDbMode && symmetric) {
+    std::cerr << "--symmetric does not apply to tame databases" << std::endl;
+    return 1;
+  }
+  if (herds != 2 && (tameDbMode || symmetric)) {
+    std::cerr << "--herds does not apply to tame databases or --symmetric"
+              << std::endl;
+    return 1;
+  }
+
+  // A precomputation has no target: walk for the generator's key
+  if (targetPubHex == "-") {
+    if (precomputeFile.empty()) {
+      printUsage();
+      return 1;
+    }
+    targetPubHex =
+        "0279BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798";
+  }
+
+  // Worker: fetch target, range, dpBits and jump table from the server
+  std::unique_ptr<DPClient> client;
+  std::vector<mpz_class> serverJumps;
+  if (!serverAddress.empty()) {
+    std::string host;
+    int port;
+    if (!DPProtocol::parseAddress(serverAddress, host, port)) {
+      std::cerr << "Invalid server address: " << serverAddress << std::endl;
+      return 1;
+    }
+
+    client.reset(new DPClient(host, port));
+    CheckpointHeader config;
+    std::vector<unsigned char> jumps;
+    std::atomic<bool> cancel{false};
+    std::cout << "Connecting to DP server " << serverAddress << "..."
+              << std::endl;
+    client->fetchConfig(config, jumps, cancel);
+
+    targetPubHex = Utils::bytesToHex(
+        std::vector<unsigned char>(config.target, config.target + 33));
+    mpz_class value;
+    Utils::bytesToMpz(value.get_mpz_t(), config.startRange);
+    startHex = "0x" + value.get_str(16);
+    Utils::bytesToMpz(value.get_mpz_t(), config.endRange);
+    endHex = "0x" + value.get_str(16);
+    if (dpBits <= 0)
+      dpBits = config.dpBits;
+    symmetric = (config.flags & kCheckpointSymmetric) != 0;
+    herds = (config.flags & kCheckpointFourHerds)    ? 4
+            : (config.flags & kCheckpointThreeHerds) ? 3
+                                                     : 2;
+    for (uint32_t i = 0; i < config.jumpCount; i++) {
+      Utils::bytesToMpz(value.get_mpz_t(), &jumps[32 * i]);
+      serverJumps.push_back(value);
+    }
+  }
+
   mpz_class start, end;
   if (start.set_str(startHex, 0) != 0) {
     std::cerr << "Error parsing start range: " << startHex << std::endl;
@@ -105,32 +293,73 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  std::vector<std::string> targets;
+  if (!parseTargets(targetPubHex, targets)) {
+    std::cerr << "Error reading targets: " << targetPubHex << std::endl;
+    return 1;
+  }
+
   std::cout << "Silikangaroo v0.2.0 - Checkpoint & Optimization" << std::endl;
-  std::cout << "Target: " << targetPubHex << std::endl;
+  if (targets.size() == 1)
+    std::cout << "Target: " << targets[0] << std::endl;
+  else
+    std::cout << "Targets: " << targets.size() << std::endl;
   std::cout << "Range: [" << start.get_str(16) << ", " << end.get_str(16) << "]"
             << std::endl;
-  if (useGPU) {
-    std::cout << "Mode: GPU Accelerated (Metal)" << std::endl;
-    std::cout << "GPU Config: Batch=" << gpuBatchSize << ", Steps=" << gpuSteps
-              << std::endl;
+  if (!backend.empty()) {
+    std::cout << "Backend: " << backend << std::endl;
+    std::cout << "Batch Config: Batch=" << gpuBatchSize
+              << ", Steps=" << gpuSteps << std::endl;
   }
 
   try {
-    Kangaroo kangaroo(start, end, targetPubHex, threads);
+    Kangaroo kangaroo(start, end, targets, threads);
     globalKangaroo = &kangaroo;
 
-    kangaroo.setUseGPU(useGPU);
+    kangaroo.setBackend(backend);
+    if (herdSize > 0)
+      kangaroo.setCpuHerdSize(herdSize);
     if (dpBits > 0)
       kangaroo.setDpBits(dpBits);
-    if (useGPU)
+    if (jumpTableSize > 0)
+      kangaroo.setJumpTableSize(jumpTableSize);
+    if (seeded)
+      kangaroo.setSeed(seed);
+    if (!backend.empty())
       kangaroo.setGpuParams(gpuBatchSize, gpuSteps);
     kangaroo.setCheckpointFile(checkpointFile);
+    if (dpMemoryMiB > 0)
+      kangaroo.setDpMemoryLimit(dpMemoryMiB << 20);
+    if (serverPort > 0)
+      kangaroo.setServerPort(serverPort);
+    if (symmetric)
+      kangaroo.setNegationMap(true);
+    if (herds != 2)
+      kangaroo.setHerds(herds);
+    if (!precomputeFile.empty())
+      kangaroo.setPrecompute(precomputeFile, tameDPs);
+    if (!tameDbFile.empty())
+      kangaroo.setTameDatabase(tameDbFile);
+    if (client) {
+      kangaroo.setJumpDistances(serverJumps);
+      kangaroo.setDPSink(client.get());
+      client->start([&kangaroo]() { kangaroo.stop(); });
+    }
 
-    if (!resumeFile.empty()) {
+    if (!resumeFile.empty() && !client && !tameDbMode) {
       std::cout << "Resuming from " << resumeFile << "..." << std::endl;
       kangaroo.loadCheckpoint(resumeFile);
     }
 
+    std::unique_ptr<MetricsExporter> exporter;
+    if (!metricsFile.empty()) {
+      exporter.reset(new MetricsExporter(kangaroo.getMetrics(), metricsFile,
+                                         metricsFormat, metricsInterval));
+      exporter->start();
+    }
+    // Samples on stdout replace the status line
+    bool statusLine = metricsFile != "-";
+
     // Monitor thread
     std::thread monitor([&]() {
       while (!kangaroo.isFound() && !kangaroo.isStopped()) {
@@ -158,9 +387,12 @@ int main(int argc, char* argv[]) {
           timeStr = std::to_string((int)remainingSeconds) + " seconds";
         }
 
-        std::cout << "\rTime: " << (int)duration << "s | Rate: " << std::fixed
-                  << std::setprecision(2) << rate / 1000000.0
-                  << " M/jumps/s | Est: " << timeStr << "      " << std::flush;
+        if (statusLine) {
+          std::cout << "\rTime: " << (int)duration << "s | Rate: "
+                    << std::fixed << std::setprecision(2) << rate / 1000000.0
+                    << " M/jumps/s | Est: " << timeStr << "      "
+                    << std::flush;
+        }
 
         // Auto-save every 5 minutes
         static auto lastSave = std::chrono::steady_clock::now();
@@ -176,17 +408,57 @@ int main(int argc, char* argv[]) {
 
     kangaroo.run();
 
-    if (kangaroo.isFound()) {
+    std::string serverKey;
+    if (client) {
+      // run() has drained the walkers: send what is still buffered
+      client->stop();
+      if (client->dropped() > 0) {
+        std::cerr << "\nWarning: " << client->dropped()
+                  << " DPs were dropped while the server was unreachable"
+                  << std::endl;
+      }
+    }
+
+    if (client && client->serverFoundKey(serverKey)) {
+      std::cout << "\n\nSUCCESS! The DP server found the key!" << std::endl;
+      std::cout << "Private Key: " << mpz_class(serverKey, 16).get_str(16)
+                << std::endl;
+    } else if (client) {
+      std::cout << "\n\nWorker stopped." << std::endl;
+    } else if (!precomputeFile.empty()) {
+      std::cout << "Precomputation finished." << std::endl;
+    } else if (kangaroo.getTargetCount() > 1) {
+      std::cout << "\n\nResults:" << std::endl;
+      for (size_t i = 0; i < targets.size(); i++) {
+        std::cout << targets[i] << ": "
+                  << (kangaroo.isSolved(i)
+                          ? kangaroo.getPrivateKeys()[i].get_str(16)
+                          : "not found")
+                  << std::endl;
+      }
+      if (!kangaroo.isFound() && !tameDbMode)
+        kangaroo.saveCheckpoint(checkpointFile);
+    } else if (kangaroo.isFound()) {
       std::cout << "\n\nSUCCESS! Private Key Found!" << std::endl;
       std::cout << "Private Key: " << kangaroo.getPrivateKey().get_str(16)
                 << std::endl;
+      double expected = kangaroo.getExpectedJumps();
+      std::cout << "Jumps: " << kangaroo.getTotalJumps() << " (expected "
+                << (uint64_t)expected << ", ratio " << std::fixed
+                << std::setprecision(2)
+                << (double)kangaroo.getTotalJumps() / expected << ")"
+                << std::endl;
     } else {
       std::cout << "\n\nSearch finished without finding key (or stopped)."
                 << std::endl;
       // Save checkpoint on exit
-      kangaroo.saveCheckpoint(checkpointFile);
+      if (!tameDbMode)
+        kangaroo.saveCheckpoint(checkpointFile);
     }
 
+    // Last sample, with the exit checkpoint
+    if (exporter)
+      exporter->stop();
   } catch (const std::exception& e) {
     std::cerr << "\nError: " << e.what() << std::endl;
     return 1;
@@ -0,0 +1,493 @@
+// silikangaroo_bench: microbenchmarks of the hot-path primitives - field
+// arithmetic, batched inversion, the herd step, the DP condition, the DP
+// table and checkpoint I/O.
+//
+// Every benchmark runs once to warm up and then --reps times; the JSON
+// report gives per-operation times (min, median, mean, stddev) so that the
+// reports of two builds can be diffed.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../include/Checkpoint.hpp"
+#include "../include/DPStore.hpp"
+#include "../include/DPTable.hpp"
+#include "../include/FieldElement.hpp"
+#include "../include/HerdStepper.hpp"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+volatile uint64_t sink;  // Keeps results alive
+
+struct Result {
+  std::string name;
+  const char* unit;       // What one operation is
+  uint64_t ops;           // Per repetition
+  double bytesPerOp = 0;  // For throughput, if it applies
+  std::vector<double> ns;  // Per operation, one per repetition
+};
+
+std::vector<Result> results;
+std::string filter;
+
+double elapsedNs(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+      .count();
+}
+
+bool selected(const std::string& name) {
+  return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// 'run' does 'ops' operations and returns the nanoseconds they took, so
+// that it can leave its setup out of the timing
+void measure(const std::string& name, const char* unit, uint64_t ops,
+             int reps, const std::function<double()>& run,
+             double bytesPerOp = 0) {
+  if (!selected(name))
+    return;
+  Result r;
+  r.name = name;
+  r.unit = unit;
+  r.ops = ops;
+  r.bytesPerOp = bytesPerOp;
+  run();
+  for (int i = 0; i < reps; i++)
+    r.ns.push_back(run() / (double)ops);
+  std::cerr << name << ": " << median(r.ns) << " ns/" << unit << std::endl;
+  results.push_back(r);
+}
+
+uint64_t splitmix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// 0 and 1 are not valid DP table fingerprints
+uint64_t fingerprint(uint64_t& state) {
+  return std::max<uint64_t>(splitmix64(state), 2);
+}
+
+FieldElement randomElement(uint64_t& state) {
+  FieldElement r;
+  for (int i = 0; i < 4; i++)
+    r.v[i] = splitmix64(state);
+  r.v[3] >>= 1;  // Below p
+  return r;
+}
+
+AffinePoint generator() {
+  AffinePoint g;
+  g.x.v[3] = 0x79BE667EF9DCBBACULL;
+  g.x.v[2] = 0x55A06295CE870B07ULL;
+  g.x.v[1] = 0x029BFCDB2DCE28D9ULL;
+  g.x.v[0] = 0x59F2815B16F81798ULL;
+  g.y.v[3] = 0x483ADA7726A3C465ULL;
+  g.y.v[2] = 0x5DA4FBFC0E1108A8ULL;
+  g.y.v[1] = 0xFD17B448A6855419ULL;
+  g.y.v[0] = 0x9C47D08FFB10D4B8ULL;
+  return g;
+}
+
+// 2^k * p
+AffinePoint doubled(AffinePoint p, int k) {
+  for (int i = 0; i < k; i++)
+    Field::addPoints(p, p);
+  return p;
+}
+
+// base, base + step, base + 2 step, ...
+std::vector<AffinePoint> pointRun(AffinePoint base, const AffinePoint& step,
+                                  size_t n) {
+  std::vector<AffinePoint> points(n);
+  for (size_t i = 0; i < n; i++) {
+    points[i] = base;
+    Field::addPoints(base, step);
+  }
+  return points;
+}
+
+void benchField(int reps) {
+  uint64_t state = 1;
+  FieldElement a = randomElement(state);
+  FieldElement b = randomElement(state);
+
+  // Dependent chains: latency rather than throughput
+  const uint64_t n = 1 << 20;
+  measure("field.mul", "op", n, reps, [&] {
+    FieldElement x = a;
+    auto t = Clock::now();
+    for (uint64_t i = 0; i < n; i++)
+      Field::mul(x, x, b);
+    double ns = elapsedNs(t);
+    sink = x.v[0];
+    return ns;
+  });
+  measure("field.sqr", "op", n, reps, [&] {
+    FieldElement x = a;
+    auto t = Clock::now();
+    for (uint64_t i = 0; i < n; i++)
+      Field::sqr(x, x);
+    double ns = elapsedNs(t);
+    sink = x.v[0];
+    return ns;
+  });
+
+  const uint64_t invs = 1 << 12;
+  measure("field.inv", "op", invs, reps, [&] {
+    FieldElement x = a;
+    auto t = Clock::now();
+    for (uint64_t i = 0; i < invs; i++)
+      Field::inv(x, x);
+    double ns = elapsedNs(t);
+    sink = x.v[0];
+    return ns;
+  });
+
+  for (size_t batch : {16, 64, 256, 1024, 4096}) {
+    std::vector<FieldElement> xs(batch), scratch(batch);
+    for (FieldElement& x : xs)
+      x = randomElement(state);
+    uint64_t rounds = std::max<uint64_t>(1, (1 << 18) / batch);
+    // Inverting twice gives the inputs back, so they stay non-zero
+    measure("field.batch_inverse/" + std::to_string(batch), "element",
+            rounds * batch, reps, [&] {
+              auto t = Clock::now();
+              for (uint64_t i = 0; i < rounds; i++)
+                Field::batchInverse(xs.data(), batch, scratch.data());
+              return elapsedNs(t);
+            });
+  }
+}
+
+void benchStep(int reps) {
+  AffinePoint g = generator();
+  for (int tableSize : {32, 2048}) {
+    std::vector<AffinePoint> jumps =
+        pointRun(doubled(g, 200), doubled(g, 3), tableSize);
+    HerdStepper stepper(jumps.data(), tableSize);
+
+    for (int herd : {64, 512, 4096}) {
+      std::vector<AffinePoint> points =
+          pointRun(doubled(g, 128), doubled(g, 64), herd);
+      std::vector<int> jumpIdx(herd);
+      uint64_t rounds = std::max(1, (1 << 18) / herd);
+      std::string name = std::string("step.") + stepper.isaName() +
+                         "/herd" + std::to_string(herd) + "/jumps" +
+                         std::to_string(tableSize);
+      measure(name, "kangaroo", rounds * herd, reps, [&] {
+        auto t = Clock::now();
+        for (uint64_t i = 0; i < rounds; i++) {
+          if (!stepper.step(points.data(), herd, jumpIdx.data()))
+            throw std::runtime_error("Herd step hit the point at infinity");
+        }
+        return elapsedNs(t);
+      });
+    }
+  }
+
+  std::vector<AffinePoint> points =
+      pointRun(doubled(g, 100), doubled(g, 50), 4096);
+  const uint64_t rounds = 256;
+  measure("is_distinguished", "op", rounds * points.size(), reps, [&] {
+    uint64_t hits = 0;
+    auto t = Clock::now();
+    for (uint64_t i = 0; i < rounds; i++) {
+      int dpBits = 8 + (int)(i & 7);
+      for (const AffinePoint& p : points)
+        hits += isDistinguished(p.x, dpBits);
+    }
+    double ns = elapsedNs(t);
+    sink = hits;
+    return ns;
+  });
+}
+
+void benchDPTable(const std::vector<uint64_t>& sizes, int reps) {
+  for (uint64_t n : sizes) {
+    std::string suffix = "/" + std::to_string(n);
+    if (!selected("dp_table.insert" + suffix) &&
+        !selected("dp_table.lookup" + suffix)) {
+      continue;
+    }
+    // Big tables take long to fill: a few repetitions are enough
+    int r = n > 10000000 ? std::min(reps, 3) : reps;
+    DPDistance dist = DPDistance::zero();
+    std::unique_ptr<DPTable> table;
+
+    // Fingerprints come from a seeded sequence instead of an n-entry array
+    auto fill = [&] {
+      table.reset();
+      table.reset(new DPTable(2 * n));
+      uint64_t state = 42;
+      auto t = Clock::now();
+      for (uint64_t i = 0; i < n; i++) {
+        dist.v[0] = i;
+        table->insert(fingerprint(state), dist, DPTable::kTagTame, nullptr);
+      }
+      return elapsedNs(t);
+    };
+    measure("dp_table.insert" + suffix, "op", n, r, fill);
+
+    if (!table || table->size() != n)
+      fill();
+    measure("dp_table.lookup" + suffix, "op", n, r, [&] {
+      uint64_t state = 42;
+      uint64_t matched = 0;
+      DPTable::Match other;
+      auto t = Clock::now();
+      for (uint64_t i = 0; i < n; i++) {
+        matched += table->insert(fingerprint(state), dist, DPTable::kTagTame,
+                                 &other) == DPTable::InsertResult::Matched;
+      }
+      double ns = elapsedNs(t);
+      sink = matched;
+      return ns;
+    });
+  }
+}
+
+// As benchDPTable, with an eighth of the DPs in memory and the rest in
+// runs under 'dir'
+void benchDPStore(const std::vector<uint64_t>& sizes, const std::string& dir,
+                  int reps) {
+  for (uint64_t n : sizes) {
+    std::string suffix = "/" + std::to_string(n);
+    if (!selected("dp_store.insert" + suffix) &&
+        !selected("dp_store.lookup" + suffix)) {
+      continue;
+    }
+    int r = n > 10000000 ? std::min(reps, 3) : reps;
+    DPDistance dist = DPDistance::zero();
+    std::unique_ptr<DPStore> store;
+    size_t limit = std::max<size_t>(n * sizeof(CheckpointRecord) / 8, 1 << 20);
+    auto tagOf = [](uint64_t i) {
+      return (uint16_t)(DPTable::kTagTame | (i & 7) << 1);
+    };
+
+    auto fill = [&] {
+      store.reset();
+      store.reset(new DPStore(2 * n, limit, dir + "/silikangaroo_bench.runs"));
+      uint64_t state = 42;
+      auto t = Clock::now();
+      for (uint64_t i = 0; i < n; i++) {
+        dist.v[0] = i;
+        store->insert(fingerprint(state), dist, tagOf(i), nullptr);
+      }
+      return elapsedNs(t);
+    };
+    measure("dp_store.insert" + suffix, "op", n, r, fill);
+
+    if (!store || store->size() != n)
+      fill();
+    measure("dp_store.lookup" + suffix, "op", n, r, [&] {
+      uint64_t state = 42;
+      uint64_t matched = 0;
+      DPTable::Match other;
+      auto t = Clock::now();
+      for (uint64_t i = 0; i < n; i++) {
+        matched += store->insert(fingerprint(state), dist, DPTable::kTagTame,
+                                 &other) == DPTable::InsertResult::Matched;
+      }
+      double ns = elapsedNs(t);
+      sink = matched;
+      return ns;
+    });
+
+    // Every DP, flushed to a run or merged since, still matches with the
+    // distance and tag it was stored with
+    uint64_t state = 42;
+    DPTable::Match other;
+    for (uint64_t i = 0; i < n; i++) {
+      if (store->insert(fingerprint(state), dist, DPTable::kTagTame,
+                        &other) != DPTable::InsertResult::Matched ||
+          other.dist.v[0] != i || other.dist.v[1] != 0 ||
+          other.dist.v[2] != 0 || other.tag != tagOf(i)) {
+        throw std::runtime_error("dp_store: DP " + std::to_string(i) +
+                                 " of " + std::to_string(n) +
+                                 " did not come back as stored");
+      }
+    }
+  }
+}
+
+void benchCheckpoint(uint64_t n, const std::string& dir, int reps) {
+  std::string save = "checkpoint.save/" + std::to_string(n);
+  std::string load = "checkpoint.load/" + std::to_string(n);
+  if (!selected(save) && !selected(load))
+    return;
+
+  std::string file = dir + "/silikangaroo_bench.checkpoint";
+  CheckpointHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.dpBits = 16;
+
+  // Written and synced like a real checkpoint
+  auto write = [&] {
+    uint64_t state = 7;
+    auto t = Clock::now();
+    CheckpointWriter writer(file, header);
+    for (uint64_t i = 0; i < n; i++) {
+      DPDistance dist = DPDistance::zero();
+      dist.v[0] = i;
+      writer.writeRecord(
+          Checkpoint::pack(splitmix64(state), dist, DPTable::kTagTame));
+    }
+    writer.finish();
+    return elapsedNs(t);
+  };
+  if (selected(save))
+    measure(save, "record", n, reps, write, sizeof(CheckpointRecord));
+  else
+    write();
+
+  // Mapping, checksum and a pass over the records, from the page cache
+  measure(
+      load, "record", n, reps,
+      [&] {
+        auto t = Clock::now();
+        CheckpointReader reader(file);
+        const CheckpointRecord* records = reader.records();
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < reader.header().dpCount; i++)
+          sum += records[i].fp;
+        double ns = elapsedNs(t);
+        sink = sum;
+        return ns;
+      },
+      sizeof(CheckpointRecord));
+  std::remove(file.c_str());
+}
+
+void writeJson(std::ostream& out, int reps) {
+  char date[32];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  out << "{\n  \"date\": \"" << date << "\",\n";
+#if defined(__VERSION__)
+  out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+  out << "  \"reps\": " << reps << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    double med = median(r.ns);
+    double min = *std::min_element(r.ns.begin(), r.ns.end());
+    double mean = 0;
+    for (double v : r.ns)
+      mean += v;
+    mean /= r.ns.size();
+    double var = 0;
+    for (double v : r.ns)
+      var += (v - mean) * (v - mean);
+    double stddev = r.ns.size() > 1 ? std::sqrt(var / (r.ns.size() - 1)) : 0;
+
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"ops\": %llu, "
+             "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+             "\"stddev_ns\": %.3f, \"ops_per_second\": %.1f",
+             i ? "," : "", r.name.c_str(), r.unit,
+             (unsigned long long)r.ops, min, med, mean, stddev, 1e9 / med);
+    out << line;
+    if (r.bytesPerOp > 0)
+      out << ", \"mb_per_second\": " << r.bytesPerOp * 1e3 / med;
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void printUsage(const char* prog) {
+  std::cout
+      << "Usage: " << prog << " [options]\n"
+      << "Options:\n"
+      << "  -o <file>           JSON report (default: stdout)\n"
+      << "  --reps <n>          Timed repetitions per benchmark (default: "
+         "10)\n"
+      << "  --filter <s>        Only benchmarks whose name contains s\n"
+      << "  --dp-entries <list> DP table sizes, comma-separated (default: "
+         "1000000,10000000);\n"
+      << "                      a table takes 64 bytes per entry\n"
+      << "  --records <n>       Checkpoint records (default: 4000000)\n"
+      << "  --tmp <dir>         Directory for the checkpoint and DP runs "
+         "(default: .)\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string outFile;
+  int reps = 10;
+  std::vector<uint64_t> dpEntries = {1000000, 10000000};
+  uint64_t records = 4000000;
+  std::string tmpDir = ".";
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      outFile = argv[++i];
+    } else if (arg == "--reps" && i + 1 < argc) {
+      reps = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--dp-entries" && i + 1 < argc) {
+      dpEntries.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        dpEntries.push_back((uint64_t)std::stod(item));
+    } else if (arg == "--records" && i + 1 < argc) {
+      records = (uint64_t)std::stod(argv[++i]);
+    } else if (arg == "--tmp" && i + 1 < argc) {
+      tmpDir = argv[++i];
+    } else {
+      printUsage(argv[0]);
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  try {
+    benchField(reps);
+    benchStep(reps);
+    benchDPTable(dpEntries, reps);
+    benchDPStore(dpEntries, tmpDir, reps);
+    benchCheckpoint(records, tmpDir, reps);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (outFile.empty()) {
+    writeJson(std::cout, reps);
+  } else {
+    std::ofstream out(outFile);
+    writeJson(out, reps);
+    if (!out) {
+      std::cerr << "Cannot write " << outFile << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,398 @@
+// dp_merge: merges the DP files of several machines working on the same
+// target and range, reports the collisions that give the key, and writes a
+// deduplicated V2 checkpoint any node can resume from.
+//
+// Records are partitioned by fingerprint into bucket files on disk, then
+// each bucket is sorted and joined in memory on its own thread, so inputs
+// may be much larger than RAM.
+
+#include <gmpxx.h>
+#include <omp.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../include/Checkpoint.hpp"
+#include "../include/DPJournal.hpp"
+#include "../include/DPTable.hpp"
+#include "../include/ECC.hpp"
+#include "../include/Utils.hpp"
+
+static void printUsage(const char* prog) {
+  std::cout
+      << "Usage: " << prog << " [options] -o <merged> <file>...\n"
+      << "Inputs are V2 checkpoints and DP journals for the same target and\n"
+      << "range (the first checkpoint provides the header and jump table).\n"
+      << "Options:\n"
+      << "  -o <file>           Merged checkpoint to write\n"
+      << "  --threads <n>       Join threads (default: all cores)\n"
+      << "  --mem <MiB>         Memory budget for the join (default: 1024)\n"
+      << "  --tmp <dir>         Directory for bucket files (default: "
+         "<merged>.parts)\n";
+}
+
+static bool sameIdentity(const CheckpointHeader& a, const CheckpointHeader& b) {
+  return std::memcmp(a.startRange, b.startRange, 32) == 0 &&
+         std::memcmp(a.endRange, b.endRange, 32) == 0 &&
+         std::memcmp(a.target, b.target, 33) == 0 && a.flags == b.flags;
+}
+
+static bool isJournal(const std::string& file) {
+  FILE* f = fopen(file.c_str(), "rb");
+  if (!f)
+    return false;
+  char magic[8];
+  bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+            std::memcmp(magic, "SKGROOJL", sizeof(magic)) == 0;
+  fclose(f);
+  return ok;
+}
+
+// Record order within a bucket: fingerprint, then type, then distance
+static bool recordLess(const CheckpointRecord& a, const CheckpointRecord& b) {
+  if (a.fp != b.fp)
+    return a.fp < b.fp;
+  if (a.distHiTag != b.distHiTag)
+    return a.distHiTag < b.distHiTag;
+  if (a.dist[1] != b.dist[1])
+    return a.dist[1] < b.dist[1];
+  return a.dist[0] < b.dist[0];
+}
+
+static std::string bucketPath(const std::string& dir, int i) {
+  return dir + "/bucket" + std::to_string(i) + ".dp";
+}
+
+// Writes the records that fall in buckets [first, first + open) of
+// 'buckets'; the others are left for another pass
+class BucketWriter {
+ public:
+  BucketWriter(const std::string& dir, int buckets, int first, int open)
+      : dir(dir), first(first) {
+    for (int i = first; i < first + open; i++) {
+      FILE* f = fopen(bucketPath(dir, i).c_str(), "wb");
+      if (!f)
+        throw std::runtime_error("Failed to create bucket file: " +
+                                 bucketPath(dir, i));
+      setvbuf(f, nullptr, _IOFBF, 1 << 16);
+      files.push_back(f);
+    }
+    shift = 64;
+    for (int b = buckets; b > 1; b >>= 1)
+      shift--;
+  }
+
+  ~BucketWriter() {
+    close();
+  }
+
+  void add(const CheckpointRecord& r) {
+    // Bucket by the top fingerprint bits; the table uses the low ones
+    size_t i = shift == 64 ? 0 : (size_t)(r.fp >> shift);
+    if (i < first || i - first >= files.size())
+      return;
+    if (fwrite(&r, sizeof(r), 1, files[i - first]) != 1)
+      throw std::runtime_error("Failed to write bucket file: " +
+                               bucketPath(dir, i));
+    count++;
+  }
+
+  void close() {
+    for (FILE* f : files)
+      fclose(f);
+    files.clear();
+  }
+
+  uint64_t count = 0;
+
+ private:
+  std::string dir;
+  size_t first;
+  std::vector<FILE*> files;
+  int shift;
+};
+
+static std::vector<CheckpointRecord> readAll(const std::string& file) {
+  std::vector<CheckpointRecord> records;
+  FILE* f = fopen(file.c_str(), "rb");
+  if (!f)
+    return records;
+  struct stat st;
+  if (fstat(fileno(f), &st) == 0) {
+    records.resize((size_t)st.st_size / sizeof(CheckpointRecord));
+    records.resize(
+        fread(records.data(), sizeof(CheckpointRecord), records.size(), f));
+  }
+  fclose(f);
+  return records;
+}
+
+int main(int argc, char* argv[]) {
+  std::string output;
+  std::string tmpDir;
+  std::vector<std::string> inputs;
+  int threads = -1;
+  size_t memMiB = 1024;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::stoi(argv[++i]);
+    } else if (arg == "--mem" && i + 1 < argc) {
+      memMiB = std::stoul(argv[++i]);
+    } else if (arg == "--tmp" && i + 1 < argc) {
+      tmpDir = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      printUsage(argv[0]);
+      return 0;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (output.empty() || inputs.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  if (threads > 0)
+    omp_set_num_threads(threads);
+  threads = omp_get_max_threads();
+  if (tmpDir.empty())
+    tmpDir = output + ".parts";
+
+  try {
+    // Header and jump table of the first checkpoint; sizes for bucketing
+    std::vector<std::string> checkpoints, journals;
+    CheckpointHeader header;
+    std::vector<unsigned char> jumps;
+    size_t totalBytes = 0;
+    for (const std::string& file : inputs) {
+      struct stat st;
+      if (stat(file.c_str(), &st) != 0)
+        throw std::runtime_error("No such file: " + file);
+      totalBytes += (size_t)st.st_size;
+
+      if (isJournal(file)) {
+        journals.push_back(file);
+        continue;
+      }
+      if (!Checkpoint::isBinary(file)) {
+        throw std::runtime_error(
+            "Not a V2 checkpoint or DP journal (resume and save V1 files "
+            "once to convert them): " +
+            file);
+      }
+
+      CheckpointReader reader(file);
+      if (checkpoints.empty()) {
+        header = reader.header();
+        jumps.assign(reader.jumps(),
+                     reader.jumps() + 32 * (size_t)header.jumpCount);
+        header.totalJumps = 0;
+        header.duration = 0;
+      } else if (!sameIdentity(header, reader.header())) {
+        throw std::runtime_error("Different target, range or mode: " + file);
+      }
+      header.totalJumps += reader.header().totalJumps;
+      header.duration += reader.header().duration;
+      checkpoints.push_back(file);
+    }
+    if (checkpoints.empty())
+      throw std::runtime_error("At least one V2 checkpoint is required");
+
+    // Each join thread holds one bucket at a time
+    int buckets = 1;
+    size_t memBytes = memMiB * 1024 * 1024;
+    while (buckets < 4 * threads || totalBytes * threads / buckets > memBytes)
+      buckets <<= 1;
+
+    // Bucket files open at once; more buckets take more passes
+    const int kOpenBuckets = 256;
+    int passes = (buckets + kOpenBuckets - 1) / kOpenBuckets;
+
+    mkdir(tmpDir.c_str(), 0755);
+    std::cout << "Partitioning " << inputs.size() << " files into " << buckets
+              << " buckets in " << tmpDir;
+    if (passes > 1)
+      std::cout << " (" << passes << " passes)";
+    std::cout << "..." << std::endl;
+
+    uint64_t inputRecords = 0;
+    for (int first = 0; first < buckets; first += kOpenBuckets) {
+      BucketWriter parts(tmpDir, buckets, first,
+                         std::min(kOpenBuckets, buckets - first));
+      for (const std::string& file : checkpoints) {
+        CheckpointReader reader(file);
+        const CheckpointRecord* records = reader.records();
+        for (uint64_t i = 0; i < reader.header().dpCount; i++)
+          parts.add(records[i]);
+      }
+      for (const std::string& file : journals) {
+        size_t n = DPJournal::replayFile(
+            file, header, [&](const CheckpointRecord& r) { parts.add(r); });
+        if (n == 0 && first == 0)
+          std::cerr << "Warning: no records for this target in " << file
+                    << std::endl;
+      }
+      inputRecords += parts.count;
+    }
+    // Sort and join every bucket; keep one record per fingerprint
+    std::vector<std::pair<CheckpointRecord, CheckpointRecord>> candidates;
+    uint64_t outputRecords = 0;
+    std::cout << "Joining " << inputRecords << " records on " << threads
+              << " threads..." << std::endl;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : outputRecords)
+    for (int b = 0; b < buckets; b++) {
+      std::vector<CheckpointRecord> records = readAll(bucketPath(tmpDir, b));
+      std::sort(records.begin(), records.end(), recordLess);
+
+      size_t kept = 0;
+      for (size_t i = 0; i < records.size();) {
+        size_t j = i;
+        const CheckpointRecord* tame = nullptr;
+        const CheckpointRecord* wilds[2] = {nullptr, nullptr};  // By herd
+        for (; j < records.size() && records[j].fp == records[i].fp; j++) {
+          uint16_t tag = Checkpoint::tag(records[j]);
+          bool isTame = (tag & DPTable::kTagTame) != 0;
+          if (isTame && !tame)
+            tame = &records[j];
+          // Only the header's target (the first of a multi-target run)
+          if (!isTame && DPTable::targetIndex(tag) == 0) {
+            int herd = (tag & DPTable::kTagSecondHerd) ? 1 : 0;
+            if (!wilds[herd])
+              wilds[herd] = &records[j];
+          }
+        }
+        const CheckpointRecord* wild = wilds[0] ? wilds[0] : wilds[1];
+        if ((tame && wild) || (wilds[0] && wilds[1])) {
+#pragma omp critical
+          {
+            if (tame && wild)
+              candidates.emplace_back(*tame, *wild);
+            // The key's two wild herds (from +-key) met
+            if (wilds[0] && wilds[1])
+              candidates.emplace_back(*wilds[0], *wilds[1]);
+          }
+        }
+        records[kept++] = records[i];
+        i = j;
+      }
+      records.resize(kept);
+
+      FILE* f = fopen(bucketPath(tmpDir, b).c_str(), "wb");
+      if (!f || fwrite(records.data(), sizeof(CheckpointRecord), kept, f) !=
+                    kept) {
+        std::cerr << "Failed to write bucket file: " << bucketPath(tmpDir, b)
+                  << std::endl;
+      }
+      if (f)
+        fclose(f);
+      outputRecords += kept;
+    }
+
+    // Verify candidates: the fingerprint may be shared by unrelated points
+    ECC ecc;
+    mpz_class N(
+        "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141", 16);
+    mpz_class startRange;
+    Utils::bytesToMpz(startRange.get_mpz_t(), header.startRange);
+    std::vector<unsigned char> target(header.target, header.target + 33);
+
+    mpz_class endRange;
+    Utils::bytesToMpz(endRange.get_mpz_t(), header.endRange);
+    mpz_class center = (startRange + endRange) / 2;
+
+    bool solved = false;
+    for (size_t i = 0; i < candidates.size() && !solved; i++) {
+      const auto& c = candidates[i];
+      std::vector<mpz_class> keys;
+      if (header.flags & kCheckpointSymmetric) {
+        // Signed distances of +-P (see Checkpoint.hpp)
+        mpz_class t =
+            Checkpoint::distance(c.first).toSignedMpz(DPTable::kDistanceBits);
+        mpz_class w =
+            Checkpoint::distance(c.second).toSignedMpz(DPTable::kDistanceBits);
+        keys = {center + t - w, center - t - w, center + w - t, center + t + w};
+      } else if (header.flags &
+                 (kCheckpointThreeHerds | kCheckpointFourHerds)) {
+        // Centred; each DP is at a * (key - center) + d, where a is 0 for
+        // tames, 1 for the first wild herd and -1 for the second. The two
+        // points are equal or opposite (see Kangaroo::verifyCollision).
+        auto sign = [](const CheckpointRecord& r) {
+          uint16_t tag = Checkpoint::tag(r);
+          if (tag & DPTable::kTagTame)
+            return 0;
+          return (tag & DPTable::kTagSecondHerd) ? -1 : 1;
+        };
+        int ak = sign(c.first);
+        int aw = sign(c.second);
+        mpz_class d =
+            Checkpoint::distance(c.first).toSignedMpz(DPTable::kDistanceBits);
+        mpz_class w =
+            Checkpoint::distance(c.second).toSignedMpz(DPTable::kDistanceBits);
+        // Factors are +-1 or +-2: halve mod N (odd) when two wilds met
+        auto solve = [&](int a, mpz_class rhs) {
+          if (a == 0)
+            return;
+          if (mpz_odd_p(rhs.get_mpz_t()))
+            rhs += N;
+          keys.push_back(center + rhs / a);
+        };
+        solve(aw - ak, d - w);
+        solve(aw + ak, -(d + w));
+      } else {
+        keys.push_back(Checkpoint::distance(c.first).toMpz() + startRange -
+                       Checkpoint::distance(c.second).toMpz());
+      }
+
+      for (mpz_class& key : keys) {
+        key %= N;
+        if (key < 0)
+          key += N;
+
+        unsigned char keyBytes[32];
+        Utils::mpzToBytes(key.get_mpz_t(), keyBytes);
+        secp256k1_pubkey pub;
+        if (ecc.getPubKeyFromPriv(pub, keyBytes) &&
+            ecc.serializePublicKey(pub, true) == target) {
+          std::cout << "\nSUCCESS! Collision found!" << std::endl;
+          std::cout << "Private Key: " << key.get_str(16) << std::endl;
+          solved = true;
+          break;
+        }
+      }
+    }
+    std::cout << candidates.size() << " fingerprint matches checked"
+              << std::endl;
+
+    // Concatenate the buckets into the merged checkpoint
+    CheckpointWriter writer(output, header);
+    writer.writeJumps(jumps.data(), header.jumpCount);
+    for (int b = 0; b < buckets; b++) {
+      std::vector<CheckpointRecord> records = readAll(bucketPath(tmpDir, b));
+      for (const CheckpointRecord& r : records)
+        writer.writeRecord(r);
+      unlink(bucketPath(tmpDir, b).c_str());
+    }
+    writer.finish();
+    rmdir(tmpDir.c_str());
+
+    std::cout << "Wrote " << outputRecords << " DPs (" << inputRecords
+              << " read) to " << output << std::endl;
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,312 @@
+// solve_bench: solves many random keys at several interval widths and
+// reports the distributions of time, jumps and jumps / sqrt(N), so that
+// algorithmic changes are judged on their expected work rather than on
+// single runs.
+//
+// Keys are drawn like gen_key's: a private key uniform in
+// [2^(b-1), 2^b - 1] and its compressed public key. Keys, jump tables and
+// starting points all derive from --seed; only thread scheduling, which
+// moves the moment a collision is seen, differs between two reports.
+//
+// A tame/wild match always gives the key, whatever the signs of the two
+// distances; the bench fails if any run verified one that did not.
+
+#include <gmpxx.h>
+#include <secp256k1.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/ECC.hpp"
+#include "../include/Kangaroo.hpp"
+#include "../include/Utils.hpp"
+
+namespace {
+
+struct Run {
+  std::string key;  // Hex
+  double seconds;
+  uint64_t jumps;
+  double expectedJumps;
+  bool solved;  // The right key within the time limit
+  uint64_t falseCandidates;
+};
+
+uint64_t splitmix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Nearest-rank quantile of sorted values
+double quantile(const std::vector<double>& sorted, double q) {
+  size_t i = (size_t)std::ceil(q * sorted.size());
+  return sorted[std::min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+std::string stats(std::vector<double> v) {
+  if (v.empty())
+    return "null";
+  std::sort(v.begin(), v.end());
+  double mean = 0;
+  for (double x : v)
+    mean += x;
+  mean /= v.size();
+  double var = 0;
+  for (double x : v)
+    var += (x - mean) * (x - mean);
+  double stddev = v.size() > 1 ? std::sqrt(var / (v.size() - 1)) : 0;
+
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"mean\": %.4g, \"stddev\": %.4g, \"min\": %.4g, \"p10\": %.4g, "
+           "\"median\": %.4g, \"p90\": %.4g, \"max\": %.4g}",
+           mean, stddev, v.front(), quantile(v, 0.1), quantile(v, 0.5),
+           quantile(v, 0.9), v.back());
+  return buf;
+}
+
+struct Options {
+  std::vector<int> widths = {20, 24, 28, 32};
+  int keys = 20;
+  uint64_t seed = 0;
+  int threads = -1;
+  int herd = 0;
+  int dpBits = 0;
+  int jumps = 0;
+  bool symmetric = false;
+  int herds = 2;
+  std::string backend;  // Empty for the CPU herds
+  int batch = 16384;
+  int steps = 256;
+  double timeout = 600;
+};
+
+Run solve(const Options& opt, int bits, gmp_randclass& rr, uint64_t seed) {
+  mpz_class start = mpz_class(1) << (bits - 1);
+  mpz_class end = (mpz_class(1) << bits) - 1;
+  mpz_class priv = start + rr.get_z_range(end - start + 1);
+
+  ECC ecc;
+  unsigned char privBytes[32];
+  Utils::mpzToBytes(priv.get_mpz_t(), privBytes);
+  secp256k1_pubkey pub;
+  if (!ecc.getPubKeyFromPriv(pub, privBytes))
+    throw std::runtime_error("Invalid private key");
+  std::string pubHex = Utils::bytesToHex(ecc.serializePublicKey(pub, true));
+
+  Kangaroo kangaroo(start, end, {pubHex}, opt.threads);
+  kangaroo.setSeed(seed);
+  if (opt.herd > 0)
+    kangaroo.setCpuHerdSize(opt.herd);
+  if (opt.dpBits > 0)
+    kangaroo.setDpBits(opt.dpBits);
+  if (opt.jumps > 0)
+    kangaroo.setJumpTableSize(opt.jumps);
+  if (opt.symmetric)
+    kangaroo.setNegationMap(true);
+  if (opt.herds != 2)
+    kangaroo.setHerds(opt.herds);
+  if (!opt.backend.empty()) {
+    kangaroo.setBackend(opt.backend);
+    kangaroo.setGpuParams(opt.batch, opt.steps);
+  }
+
+  // Stops the run at the time limit
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  std::thread watchdog([&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!cv.wait_for(lock, std::chrono::duration<double>(opt.timeout),
+                     [&] { return done; })) {
+      kangaroo.stop();
+    }
+  });
+
+  kangaroo.run();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  cv.notify_one();
+  watchdog.join();
+
+  Run r;
+  r.key = priv.get_str(16);
+  r.seconds = kangaroo.getDuration();
+  r.jumps = kangaroo.getTotalJumps();
+  r.expectedJumps = kangaroo.getExpectedJumps();
+  r.solved = kangaroo.isFound() && kangaroo.getPrivateKey() == priv;
+  r.falseCandidates = kangaroo.getMetrics().total(Metrics::FalseCandidates);
+  return r;
+}
+
+void printUsage(const char* prog) {
+  std::cout
+      << "Usage: " << prog << " [options]\n"
+      << "Options:\n"
+      << "  -o <file>           JSON report (default: stdout)\n"
+      << "  --bits <list>       Interval widths in bits, comma-separated, "
+         "20..48\n"
+      << "                      (default: 20,24,28,32)\n"
+      << "  --keys <n>          Keys per width (default: 20)\n"
+      << "  --seed <n>          Seed for the keys and the solver (default: "
+         "random)\n"
+      << "  --timeout <s>       Give up on a key after this long (default: "
+         "600)\n"
+      << "  --threads, --herd, --dp, --jumps, --symmetric, --herds,\n"
+      << "  --backend, --batch, --steps\n"
+      << "                      Passed on to the solver\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  opt.seed = std::random_device()();
+  std::string outFile;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      outFile = argv[++i];
+    } else if (arg == "--bits" && i + 1 < argc) {
+      opt.widths.clear();
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ','))
+        opt.widths.push_back(std::stoi(item));
+    } else if (arg == "--keys" && i + 1 < argc) {
+      opt.keys = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--seed" && i + 1 < argc) {
+      opt.seed = std::stoull(argv[++i], nullptr, 0);
+    } else if (arg == "--timeout" && i + 1 < argc) {
+      opt.timeout = std::stod(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      opt.threads = std::stoi(argv[++i]);
+    } else if (arg == "--herd" && i + 1 < argc) {
+      opt.herd = std::stoi(argv[++i]);
+    } else if (arg == "--dp" && i + 1 < argc) {
+      opt.dpBits = std::stoi(argv[++i]);
+    } else if (arg == "--jumps" && i + 1 < argc) {
+      opt.jumps = std::stoi(argv[++i]);
+    } else if (arg == "--symmetric") {
+      opt.symmetric = true;
+    } else if (arg == "--herds" && i + 1 < argc) {
+      opt.herds = std::stoi(argv[++i]);
+    } else if (arg == "--backend" && i + 1 < argc) {
+      opt.backend = argv[++i];
+    } else if (arg == "--batch" && i + 1 < argc) {
+      opt.batch = std::stoi(argv[++i]);
+    } else if (arg == "--steps" && i + 1 < argc) {
+      opt.steps = std::stoi(argv[++i]);
+    } else {
+      printUsage(argv[0]);
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+  for (int bits : opt.widths) {
+    if (bits < 20 || bits > 48) {
+      std::cerr << "Widths must lie in 20..48 bits" << std::endl;
+      return 1;
+    }
+  }
+
+  std::ostringstream report;
+  report << "{\n  \"seed\": " << opt.seed << ",\n  \"threads\": "
+         << opt.threads << ",\n  \"symmetric\": "
+         << (opt.symmetric ? "true" : "false") << ",\n  \"herds\": "
+         << opt.herds << ",\n  \"backend\": \""
+         << (opt.backend.empty() ? "none" : opt.backend)
+         << "\",\n  \"widths\": [";
+
+  // The solver's progress would drown the summary
+  std::ofstream devNull("/dev/null");
+  uint64_t state = opt.seed;
+  uint64_t falseCandidates = 0;
+  for (size_t w = 0; w < opt.widths.size(); w++) {
+    int bits = opt.widths[w];
+    gmp_randclass rr(gmp_randinit_default);
+    rr.seed(mpz_class((unsigned long)splitmix64(state)));
+    double sqrtN = std::sqrt(std::ldexp(1.0, bits - 1));
+
+    std::vector<Run> runs;
+    std::vector<double> seconds, jumps, ratio, expected;
+    for (int k = 0; k < opt.keys; k++) {
+      std::streambuf* cout = std::cout.rdbuf(devNull.rdbuf());
+      Run r;
+      try {
+        r = solve(opt, bits, rr, splitmix64(state));
+      } catch (const std::exception& e) {
+        std::cout.rdbuf(cout);
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+      }
+      std::cout.rdbuf(cout);
+
+      runs.push_back(r);
+      falseCandidates += r.falseCandidates;
+      expected.push_back(r.expectedJumps / sqrtN);
+      if (r.solved) {
+        seconds.push_back(r.seconds);
+        jumps.push_back((double)r.jumps);
+        ratio.push_back((double)r.jumps / sqrtN);
+      }
+      std::cerr << "\r" << bits << " bits: " << k + 1 << "/" << opt.keys
+                << " keys, " << ratio.size() << " solved" << std::flush;
+    }
+    std::cerr << std::endl;
+
+    report << (w ? "," : "") << "\n    {\"bits\": " << bits
+           << ", \"keys\": " << opt.keys << ", \"solved\": " << ratio.size()
+           << ",\n     \"seconds\": " << stats(seconds)
+           << ",\n     \"jumps\": " << stats(jumps)
+           << ",\n     \"jumps_per_sqrt_n\": " << stats(ratio)
+           << ",\n     \"expected_per_sqrt_n\": " << stats(expected)
+           << ",\n     \"runs\": [";
+    for (size_t i = 0; i < runs.size(); i++) {
+      char buf[200];
+      snprintf(buf, sizeof(buf),
+               "%s{\"key\": \"%s\", \"solved\": %s, \"seconds\": %.3f, "
+               "\"jumps\": %llu, \"false_candidates\": %llu}",
+               i ? ", " : "", runs[i].key.c_str(),
+               runs[i].solved ? "true" : "false", runs[i].seconds,
+               (unsigned long long)runs[i].jumps,
+               (unsigned long long)runs[i].falseCandidates);
+      report << buf;
+    }
+    report << "]}";
+  }
+  report << "\n  ]\n}\n";
+
+  if (outFile.empty()) {
+    std::cout << report.str();
+  } else {
+    std::ofstream out(outFile);
+    out << report.str();
+    if (!out) {
+      std::cerr << "Cannot write " << outFile << std::endl;
+      return 1;
+    }
+  }
+  if (falseCandidates > 0) {
+    std::cerr << falseCandidates << " tame/wild matches gave no key"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}